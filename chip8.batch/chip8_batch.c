@@ -0,0 +1,542 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8.h"
+#include "chip8_input_log.h"
+#include "chip8_platform.h"
+#include "chip8_script.h"
+
+/*
+	chip8-batch - runs many (ROM, input script) jobs headless, in parallel.
+
+	Usage: chip8-batch <manifest> <output> [options]
+
+	--threads N			number of workers (default: one per CPU)
+	--ipf K				instructions per frame (default CHIP8_INSTRUCTIONS_PER_FRAME)
+	--engine E			interpreter, blocks or jit (default interpreter)
+	--hash-interval N	record the screen hash every N frames (default 60, 0 for none)
+	--seed S			seed of the random number generator of every job (default CHIP8_DEFAULT_RANDOM_SEED)
+
+	The manifest has one job per line, empty lines and lines starting with # are ignored:
+
+	<rom> <frames> [input]
+
+	where input is either a script (see chip8_script.h) or an input log recorded by the
+	frontend (see chip8_input_log.h), which is replayed with its own seed and instructions
+	per frame.
+
+	Jobs are dealt round-robin to the workers, each with its own deque and its own
+	struct chip8. A worker takes jobs from the back of its deque and, once it is empty,
+	steals from the front of the others', so long jobs don't leave workers idle.
+
+	Results are written to the output as soon as a job finishes, one JSON object per line,
+	so they are not in manifest order: use the "job" field (the line in the manifest).
+ */
+
+static const char* engine_names[] = { "interpreter", "blocks", "jit" };
+
+struct batch_job
+{
+	char* rom;
+	char* script;
+	unsigned long long frames;
+	int line;
+};
+
+struct batch_deque
+{
+	struct chip8_mutex* mutex;
+	int* jobs;
+	// Jobs left are jobs[top] to jobs[bottom - 1]
+	int top;
+	int bottom;
+};
+
+struct batch
+{
+	struct batch_job* jobs;
+	int total_jobs;
+	struct batch_deque* deques;
+	int total_workers;
+
+	int instructions_per_frame;
+	enum chip8_engine engine;
+	unsigned long long hash_interval;
+	unsigned long long seed;
+
+	FILE* output;
+	struct chip8_mutex* output_mutex;
+};
+
+struct batch_worker
+{
+	struct batch* batch;
+	int index;
+};
+
+// A growable string, results are built in memory and written with a single fwrite
+struct batch_buffer
+{
+	char* data;
+	size_t length;
+	size_t capacity;
+};
+
+static void batch_append(struct batch_buffer* buffer, const char* format, ...)
+{
+	for (;;)
+	{
+		va_list arguments;
+		va_start(arguments, format);
+		const size_t available = buffer->capacity - buffer->length;
+		const int written = vsnprintf(buffer->data ? buffer->data + buffer->length : NULL, available, format, arguments);
+		va_end(arguments);
+
+		if (written < 0)
+		{
+			return;
+		}
+		if ((size_t)written < available)
+		{
+			buffer->length += written;
+			return;
+		}
+
+		const size_t capacity = (buffer->capacity + written + 1) * 2;
+		char* data = realloc(buffer->data, capacity);
+		if (data == NULL)
+		{
+			return;
+		}
+		buffer->data = data;
+		buffer->capacity = capacity;
+	}
+}
+
+static void batch_append_string(struct batch_buffer* buffer, const char* text)
+{
+	batch_append(buffer, "\"");
+	for (; *text != '\0'; text++)
+	{
+		batch_append(buffer, *text == '"' || *text == '\\' ? "\\%c" : "%c", *text);
+	}
+	batch_append(buffer, "\"");
+}
+
+static bool batch_take_job(struct batch* batch, const int worker, int* job)
+{
+	// own jobs first, from the back
+	struct batch_deque* own = &batch->deques[worker];
+	chip8_platform_mutex_lock(own->mutex);
+	const bool has_job = own->top < own->bottom;
+	if (has_job)
+	{
+		*job = own->jobs[--own->bottom];
+	}
+	chip8_platform_mutex_unlock(own->mutex);
+	if (has_job)
+	{
+		return true;
+	}
+
+	// then steal from the front of the others
+	for (int i = 1; i < batch->total_workers; i++)
+	{
+		struct batch_deque* victim = &batch->deques[(worker + i) % batch->total_workers];
+		chip8_platform_mutex_lock(victim->mutex);
+		const bool stolen = victim->top < victim->bottom;
+		if (stolen)
+		{
+			*job = victim->jobs[victim->top++];
+		}
+		chip8_platform_mutex_unlock(victim->mutex);
+		if (stolen)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool batch_run_job(const struct batch* batch, const struct batch_job* job, struct chip8* chip8, struct batch_buffer* result)
+{
+	size_t rom_size;
+	char* rom = chip8_platform_read_file(job->rom, &rom_size);
+	if (rom == NULL || rom_size + CHIP8_PROGRAM_LOAD_ADDRESS >= CHIP8_MEMORY_SIZE)
+	{
+		free(rom);
+		batch_append(result, ", \"error\": \"failed to read the ROM\"");
+		return false;
+	}
+
+	struct chip8_script script = { 0 };
+	struct chip8_input_replay replay;
+	char* input = NULL;
+	bool is_replay = false;
+	if (job->script != NULL)
+	{
+		size_t input_size;
+		input = chip8_platform_read_file(job->script, &input_size);
+		is_replay = input != NULL && chip8_input_replay_open(&replay, input, input_size);
+		int error_line = 0;
+		if (!is_replay && (input == NULL || !chip8_script_parse(&script, input, &error_line)))
+		{
+			free(input);
+			free(rom);
+			batch_append(result, ", \"error\": \"failed to read the script (line %d)\"", error_line);
+			return false;
+		}
+	}
+
+	int instructions_per_frame = batch->instructions_per_frame;
+	chip8_init(chip8);
+	chip8_seed(chip8, is_replay ? replay.seed : batch->seed);
+	chip8_load(chip8, rom, rom_size);
+	free(rom);
+	if (is_replay)
+	{
+		instructions_per_frame = replay.instructions_per_frame;
+		if (replay.image_hash != chip8->memory.image->hash)
+		{
+			free(input);
+			chip8_destroy(chip8);
+			batch_append(result, ", \"error\": \"input log recorded with another ROM\"");
+			return false;
+		}
+	}
+	if (!chip8_set_engine(chip8, batch->engine))
+	{
+		chip8_script_free(&script);
+		free(input);
+		chip8_destroy(chip8);
+		batch_append(result, ", \"error\": \"engine not supported\"");
+		return false;
+	}
+
+	chip8_set_instructions_per_tick(chip8, instructions_per_frame);
+	// Once the program halts with its timers run out nothing changes any more, so the
+	// rest of the frames are not run: they would only repeat the same screen
+	unsigned long long halted_frame = 0;
+	// Only rehashed when rows changed in between
+	unsigned long long screen_hash = chip8_screen_hash(&chip8->screen);
+	chip8_screen_take_dirty_rows(&chip8->screen);
+	batch_append(result, ", \"frame_hashes\": [");
+	for (unsigned long long frame = 0; frame < job->frames; frame++)
+	{
+		if (halted_frame == 0)
+		{
+			if (is_replay)
+			{
+				chip8_input_replay_run_frame(&replay, chip8, frame);
+				chip8_tick_timers(chip8);
+			}
+			else
+			{
+				chip8_script_apply(&script, &chip8->keyboard, (unsigned int)frame);
+				chip8_advance(chip8, instructions_per_frame);
+			}
+
+			if (chip8_activity(chip8) == CHIP8_HALTED && chip8->registers.delay_timer == 0 && chip8->registers.sound_timer == 0)
+			{
+				halted_frame = frame + 1;
+			}
+		}
+
+		if (batch->hash_interval > 0 && (frame + 1) % batch->hash_interval == 0)
+		{
+			if (chip8_screen_take_dirty_rows(&chip8->screen) != 0)
+			{
+				screen_hash = chip8_screen_hash(&chip8->screen);
+			}
+			batch_append(result, "%s\"%016llx\"", frame + 1 == batch->hash_interval ? "" : ", ", screen_hash);
+		}
+	}
+	batch_append(result, "]");
+
+	const struct chip8_registers* registers = &chip8->registers;
+	batch_append(result, ", \"instructions\": %llu", job->frames * instructions_per_frame);
+	if (halted_frame > 0)
+	{
+		batch_append(result, ", \"halted_frame\": %llu", halted_frame);
+	}
+	batch_append(result, ", \"screen_hash\": \"%016llx\"", chip8_screen_hash(&chip8->screen));
+	batch_append(result, ", \"registers\": {\"V\": [");
+	for (int i = 0; i < CHIP8_TOTAL_DATA_REGISTERS; i++)
+	{
+		batch_append(result, i == 0 ? "%d" : ", %d", registers->V[i]);
+	}
+	batch_append(result, "], \"I\": %d, \"PC\": %d, \"SP\": %d, \"DT\": %d, \"ST\": %d}",
+		registers->I, registers->PC, registers->SP, registers->delay_timer, registers->sound_timer);
+
+	chip8_script_free(&script);
+	free(input);
+	chip8_destroy(chip8);
+	return true;
+}
+
+static void batch_worker_run(void* argument)
+{
+	const struct batch_worker* worker = argument;
+	struct batch* batch = worker->batch;
+	struct chip8* chip8 = calloc(1, sizeof(struct chip8));
+	struct batch_buffer result = { 0 };
+	if (chip8 == NULL)
+	{
+		return;
+	}
+
+	int index;
+	while (batch_take_job(batch, worker->index, &index))
+	{
+		const struct batch_job* job = &batch->jobs[index];
+		result.length = 0;
+		batch_append(&result, "{\"job\": %d, \"rom\": ", job->line);
+		batch_append_string(&result, job->rom);
+		if (job->script != NULL)
+		{
+			batch_append(&result, ", \"script\": ");
+			batch_append_string(&result, job->script);
+		}
+		batch_append(&result, ", \"frames\": %llu", job->frames);
+		batch_run_job(batch, job, chip8, &result);
+		batch_append(&result, "}\n");
+
+		chip8_platform_mutex_lock(batch->output_mutex);
+		fwrite(result.data, 1, result.length, batch->output);
+		fflush(batch->output);
+		chip8_platform_mutex_unlock(batch->output_mutex);
+	}
+
+	free(result.data);
+	free(chip8);
+}
+
+static char* batch_copy(const char* text)
+{
+	char* copy = malloc(strlen(text) + 1);
+	if (copy != NULL)
+	{
+		strcpy(copy, text);
+	}
+	return copy;
+}
+
+static bool batch_read_manifest(struct batch* batch, const char* filename)
+{
+	size_t size;
+	char* text = chip8_platform_read_file(filename, &size);
+	if (text == NULL)
+	{
+		fprintf(stderr, "Failed to read the manifest %s\n", filename);
+		return false;
+	}
+
+	int capacity = 0;
+	int line_number = 0;
+	char* next = text;
+	while (*next != '\0')
+	{
+		char* line = next;
+		char* end = strchr(line, '\n');
+		if (end != NULL)
+		{
+			*end = '\0';
+			next = end + 1;
+		}
+		else
+		{
+			next = line + strlen(line);
+		}
+		line_number++;
+
+		char rom[1024];
+		char script[1024];
+		unsigned long long frames;
+		const int fields = sscanf(line, "%1023s %llu %1023s", rom, &frames, script);
+		if (fields <= 0 || rom[0] == '#')
+		{
+			continue;
+		}
+		if (fields < 2)
+		{
+			fprintf(stderr, "%s:%d: expected <rom> <frames> [input]\n", filename, line_number);
+			free(text);
+			return false;
+		}
+
+		if (batch->total_jobs == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 64;
+			struct batch_job* jobs = realloc(batch->jobs, capacity * sizeof(struct batch_job));
+			if (jobs == NULL)
+			{
+				free(text);
+				return false;
+			}
+			batch->jobs = jobs;
+		}
+
+		struct batch_job* job = &batch->jobs[batch->total_jobs++];
+		job->rom = batch_copy(rom);
+		job->script = fields == 3 ? batch_copy(script) : NULL;
+		job->frames = frames;
+		job->line = line_number;
+	}
+
+	free(text);
+	return true;
+}
+
+static void usage(const char* program)
+{
+	fprintf(stderr, "Usage: %s <manifest> <output> [--threads N] [--ipf K] [--engine interpreter|blocks|jit] [--hash-interval N] [--seed S]\n", program);
+}
+
+int main(const int argc, const char** argv)
+{
+	if (argc < 3)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	struct batch batch = { 0 };
+	batch.instructions_per_frame = CHIP8_INSTRUCTIONS_PER_FRAME;
+	batch.engine = CHIP8_ENGINE_INTERPRETER;
+	batch.hash_interval = CHIP8_FRAMES_PER_SECOND;
+	batch.seed = CHIP8_DEFAULT_RANDOM_SEED;
+	batch.total_workers = chip8_platform_cpu_count();
+
+	for (int i = 3; i < argc; i += 2)
+	{
+		const char* option = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL)
+		{
+			usage(argv[0]);
+			return -1;
+		}
+
+		if (strcmp(option, "--threads") == 0)
+		{
+			batch.total_workers = atoi(value);
+		}
+		else if (strcmp(option, "--ipf") == 0)
+		{
+			batch.instructions_per_frame = atoi(value);
+		}
+		else if (strcmp(option, "--hash-interval") == 0)
+		{
+			batch.hash_interval = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(option, "--seed") == 0)
+		{
+			batch.seed = strtoull(value, NULL, 0);
+		}
+		else if (strcmp(option, "--engine") == 0)
+		{
+			int found = -1;
+			for (int e = 0; e < (int)(sizeof(engine_names) / sizeof(engine_names[0])); e++)
+			{
+				if (strcmp(value, engine_names[e]) == 0)
+				{
+					found = e;
+				}
+			}
+			if (found < 0)
+			{
+				fprintf(stderr, "Unknown engine %s\n", value);
+				return -1;
+			}
+			batch.engine = (enum chip8_engine)found;
+		}
+		else
+		{
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (batch.total_workers <= 0 || batch.instructions_per_frame <= 0)
+	{
+		fprintf(stderr, "The number of threads and of instructions per frame must be positive\n");
+		return -1;
+	}
+
+	if (!batch_read_manifest(&batch, argv[1]))
+	{
+		return -1;
+	}
+	if (batch.total_workers > batch.total_jobs)
+	{
+		batch.total_workers = batch.total_jobs > 0 ? batch.total_jobs : 1;
+	}
+
+	batch.output = fopen(argv[2], "w");
+	if (batch.output == NULL)
+	{
+		fprintf(stderr, "Failed to create the file %s\n", argv[2]);
+		return -1;
+	}
+	batch.output_mutex = chip8_platform_mutex_create();
+
+	// deal the jobs round-robin
+	batch.deques = calloc(batch.total_workers, sizeof(struct batch_deque));
+	for (int w = 0; w < batch.total_workers; w++)
+	{
+		struct batch_deque* deque = &batch.deques[w];
+		deque->mutex = chip8_platform_mutex_create();
+		deque->jobs = malloc((batch.total_jobs / batch.total_workers + 1) * sizeof(int));
+		for (int j = w; j < batch.total_jobs; j += batch.total_workers)
+		{
+			deque->jobs[deque->bottom++] = j;
+		}
+	}
+
+	const unsigned long long start = chip8_platform_time_ns();
+
+	struct batch_worker* workers = calloc(batch.total_workers, sizeof(struct batch_worker));
+	struct chip8_thread** threads = calloc(batch.total_workers, sizeof(struct chip8_thread*));
+	for (int w = 0; w < batch.total_workers; w++)
+	{
+		workers[w].batch = &batch;
+		workers[w].index = w;
+		threads[w] = chip8_platform_thread_create(batch_worker_run, &workers[w]);
+		if (threads[w] == NULL)
+		{
+			// the other workers will steal its jobs
+			fprintf(stderr, "Failed to start worker %d\n", w);
+		}
+	}
+	for (int w = 0; w < batch.total_workers; w++)
+	{
+		if (threads[w] != NULL)
+		{
+			chip8_platform_thread_join(threads[w]);
+		}
+	}
+
+	const double seconds = (double)(chip8_platform_time_ns() - start) / 1e9;
+	fprintf(stderr, "%d jobs on %d workers in %.3f seconds\n", batch.total_jobs, batch.total_workers, seconds);
+
+	fclose(batch.output);
+	chip8_platform_mutex_destroy(batch.output_mutex);
+	for (int w = 0; w < batch.total_workers; w++)
+	{
+		chip8_platform_mutex_destroy(batch.deques[w].mutex);
+		free(batch.deques[w].jobs);
+	}
+	for (int j = 0; j < batch.total_jobs; j++)
+	{
+		free(batch.jobs[j].rom);
+		free(batch.jobs[j].script);
+	}
+	free(batch.deques);
+	free(batch.jobs);
+	free(workers);
+	free(threads);
+	return 0;
+}
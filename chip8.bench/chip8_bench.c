@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8.h"
+#include "chip8_input_log.h"
+#include "chip8_platform.h"
+#include "chip8_script.h"
+
+/*
+	chip8-bench - runs a ROM headless and reports how fast it ran, as JSON on stdout.
+
+	Usage: chip8-bench <rom> [options]
+
+	--frames N			run N frames (default 600, ten seconds of emulated time)
+	--instructions M	run M instructions instead of a number of frames
+	--ipf K				instructions per frame (default CHIP8_INSTRUCTIONS_PER_FRAME)
+	--engine E			interpreter, blocks or jit (default interpreter)
+	--script FILE		scripted input, see chip8_script.h
+	--seed S			seed of the random number generator (default CHIP8_DEFAULT_RANDOM_SEED)
+	--replay FILE		replays an input log recorded by the frontend, with its seed and instructions
+						per frame, for as many frames as the session lasted unless --frames is given
+
+	The final screen hash lets two runs (or two engines) be checked for identical output.
+ */
+
+static const char* engine_names[] = { "interpreter", "blocks", "jit" };
+
+static void print_json_string(const char* text)
+{
+	putchar('"');
+	for (; *text != '\0'; text++)
+	{
+		if (*text == '"' || *text == '\\')
+		{
+			putchar('\\');
+		}
+		putchar(*text);
+	}
+	putchar('"');
+}
+
+static void usage(const char* program)
+{
+	fprintf(stderr, "Usage: %s <rom> [--frames N | --instructions M] [--ipf K] [--engine interpreter|blocks|jit] [--script FILE | --replay FILE] [--seed S]\n", program);
+}
+
+int main(const int argc, const char** argv)
+{
+	if (argc < 2)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	const char* rom_filename = argv[1];
+	unsigned long long frames = 600;
+	unsigned long long instructions = 0;
+	int instructions_per_frame = CHIP8_INSTRUCTIONS_PER_FRAME;
+	enum chip8_engine engine = CHIP8_ENGINE_INTERPRETER;
+	const char* script_filename = NULL;
+	const char* replay_filename = NULL;
+	bool has_frames = false;
+	unsigned long long seed = CHIP8_DEFAULT_RANDOM_SEED;
+
+	for (int i = 2; i < argc; i++)
+	{
+		const char* option = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL)
+		{
+			usage(argv[0]);
+			return -1;
+		}
+		i++;
+
+		if (strcmp(option, "--frames") == 0)
+		{
+			frames = strtoull(value, NULL, 10);
+			instructions = 0;
+			has_frames = true;
+		}
+		else if (strcmp(option, "--instructions") == 0)
+		{
+			instructions = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(option, "--ipf") == 0)
+		{
+			instructions_per_frame = atoi(value);
+		}
+		else if (strcmp(option, "--engine") == 0)
+		{
+			int found = -1;
+			for (int e = 0; e < (int)(sizeof(engine_names) / sizeof(engine_names[0])); e++)
+			{
+				if (strcmp(value, engine_names[e]) == 0)
+				{
+					found = e;
+				}
+			}
+			if (found < 0)
+			{
+				fprintf(stderr, "Unknown engine %s\n", value);
+				return -1;
+			}
+			engine = (enum chip8_engine)found;
+		}
+		else if (strcmp(option, "--script") == 0)
+		{
+			script_filename = value;
+		}
+		else if (strcmp(option, "--replay") == 0)
+		{
+			replay_filename = value;
+		}
+		else if (strcmp(option, "--seed") == 0)
+		{
+			seed = strtoull(value, NULL, 0);
+		}
+		else
+		{
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (script_filename != NULL && replay_filename != NULL)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (instructions_per_frame <= 0)
+	{
+		fprintf(stderr, "The number of instructions per frame must be positive\n");
+		return -1;
+	}
+
+	size_t rom_size;
+	char* rom = chip8_platform_read_file(rom_filename, &rom_size);
+	if (rom == NULL)
+	{
+		fprintf(stderr, "Failed to read the ROM %s\n", rom_filename);
+		return -1;
+	}
+
+	struct chip8_script script = { 0 };
+	if (script_filename != NULL)
+	{
+		size_t script_size;
+		char* text = chip8_platform_read_file(script_filename, &script_size);
+		int error_line = 0;
+		if (text == NULL || !chip8_script_parse(&script, text, &error_line))
+		{
+			fprintf(stderr, "Failed to read the script %s (line %d)\n", script_filename, error_line);
+			free(text);
+			free(rom);
+			return -1;
+		}
+		free(text);
+	}
+
+	struct chip8_input_replay replay;
+	char* log = NULL;
+	if (replay_filename != NULL)
+	{
+		size_t log_size;
+		log = chip8_platform_read_file(replay_filename, &log_size);
+		if (log == NULL || !chip8_input_replay_open(&replay, log, log_size))
+		{
+			fprintf(stderr, "Failed to read the input log %s\n", replay_filename);
+			free(log);
+			free(rom);
+			return -1;
+		}
+		// a replay is only exact with the settings it was recorded with
+		seed = replay.seed;
+		instructions_per_frame = replay.instructions_per_frame;
+		if (!has_frames)
+		{
+			frames = replay.frames;
+		}
+		instructions = 0;
+	}
+
+	static struct chip8 chip8;
+	chip8_init(&chip8);
+	chip8_seed(&chip8, seed);
+	chip8_load(&chip8, rom, rom_size);
+	if (log != NULL && replay.image_hash != chip8.memory.image->hash)
+	{
+		fprintf(stderr, "The input log %s was recorded with another ROM\n", replay_filename);
+		return -1;
+	}
+	if (!chip8_set_engine(&chip8, engine))
+	{
+		fprintf(stderr, "The %s engine is not supported on this host\n", engine_names[engine]);
+		return -1;
+	}
+
+	unsigned long long executed = 0;
+	unsigned long long frame = 0;
+	const unsigned long long start = chip8_platform_time_ns();
+	while (instructions > 0 ? executed < instructions : frame < frames)
+	{
+		int budget = instructions_per_frame;
+		if (instructions > 0 && instructions - executed < (unsigned long long)budget)
+		{
+			budget = (int)(instructions - executed);
+		}
+
+		if (log != NULL)
+		{
+			chip8_input_replay_run_frame(&replay, &chip8, frame);
+		}
+		else
+		{
+			chip8_script_apply(&script, &chip8.keyboard, (unsigned int)frame);
+			chip8_run(&chip8, budget);
+		}
+		chip8_tick_timers(&chip8);
+		executed += budget;
+		frame++;
+	}
+	const unsigned long long elapsed = chip8_platform_time_ns() - start;
+	const double seconds = elapsed > 0 ? (double)elapsed / 1e9 : 1e-9;
+
+	printf("{\n");
+	printf("\t\"rom\": ");
+	print_json_string(rom_filename);
+	printf(",\n");
+	printf("\t\"engine\": \"%s\",\n", engine_names[engine]);
+	printf("\t\"instructions_per_frame\": %d,\n", instructions_per_frame);
+	printf("\t\"frames\": %llu,\n", frame);
+	printf("\t\"instructions\": %llu,\n", executed);
+	printf("\t\"wall_time_seconds\": %.6f,\n", seconds);
+	printf("\t\"instructions_per_second\": %.0f,\n", (double)executed / seconds);
+	printf("\t\"frames_per_second\": %.1f,\n", (double)frame / seconds);
+	printf("\t\"screen_hash\": \"%016llx\"\n", chip8_screen_hash(&chip8.screen));
+	printf("}\n");
+
+	chip8_script_free(&script);
+	chip8_destroy(&chip8);
+	free(log);
+	free(rom);
+	return 0;
+}
@@ -0,0 +1,168 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <string>
+
+extern "C" {
+#include "chip8.h"
+}
+
+/*
+	Micro-benchmarks of the core primitives.
+
+	Save the results as JSON with
+	chip8.benchmarks --benchmark_out=results.json --benchmark_out_format=json
+	and compare two runs with tools/compare.py from Google Benchmark.
+ */
+
+static const char keyboard_map[CHIP_TOTAL_KEYS] = {
+	'0', '1', '2', '3', '4', '5', '6', '7',
+	'8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+static std::unique_ptr<chip8> make_chip8()
+{
+	std::unique_ptr<chip8> instance(new chip8);
+	chip8_init(instance.get());
+	chip8_keyboard_set_map(&instance->keyboard, keyboard_map);
+	// V0 = 3 is a valid key and font digit for Ex9E, ExA1 and Fx29
+	for (int i = 0; i < CHIP8_TOTAL_DATA_REGISTERS; i++)
+	{
+		instance->registers.V[i] = (unsigned char)(i * 17 + 3);
+	}
+	instance->registers.I = 0x300;
+	return instance;
+}
+
+struct opcode_benchmark
+{
+	const char* name;
+	unsigned short opcode;
+	// executed after the opcode to undo side effects that would break the next iteration
+	unsigned short undo;
+};
+
+static const opcode_benchmark opcode_benchmarks[] = {
+	{ "CLS", 0x00E0, 0 },
+	{ "CALL_RET", 0x2300, 0x00EE },
+	{ "JP_addr", 0x1200, 0 },
+	{ "SE_Vx_byte", 0x3103, 0 },
+	{ "SNE_Vx_byte", 0x4103, 0 },
+	{ "SE_Vx_Vy", 0x5120, 0 },
+	{ "LD_Vx_byte", 0x6142, 0 },
+	{ "ADD_Vx_byte", 0x7101, 0 },
+	{ "LD_Vx_Vy", 0x8120, 0 },
+	{ "OR_Vx_Vy", 0x8121, 0 },
+	{ "AND_Vx_Vy", 0x8122, 0 },
+	{ "XOR_Vx_Vy", 0x8123, 0 },
+	{ "ADD_Vx_Vy", 0x8124, 0 },
+	{ "SUB_Vx_Vy", 0x8125, 0 },
+	{ "SHR_Vx", 0x8106, 0 },
+	{ "SUBN_Vx_Vy", 0x8127, 0 },
+	{ "SHL_Vx", 0x810E, 0 },
+	{ "SNE_Vx_Vy", 0x9120, 0 },
+	{ "LD_I_addr", 0xA300, 0 },
+	{ "JP_V0_addr", 0xB200, 0 },
+	{ "RND_Vx_byte", 0xC1FF, 0 },
+	{ "DRW_Vx_Vy_nibble", 0xD125, 0 },
+	{ "SKP_Vx", 0xE09E, 0 },
+	{ "SKNP_Vx", 0xE0A1, 0 },
+	{ "LD_Vx_DT", 0xF107, 0 },
+	{ "LD_Vx_K", 0xF10A, 0 },
+	{ "LD_DT_Vx", 0xF115, 0 },
+	{ "LD_ST_Vx", 0xF118, 0 },
+	{ "ADD_I_Vx", 0xF11E, 0xA300 },
+	{ "LD_F_Vx", 0xF029, 0 },
+	{ "LD_B_Vx", 0xF133, 0 },
+	{ "LD_I_Vx", 0xFF55, 0 },
+	{ "LD_Vx_I", 0xFF65, 0 },
+};
+
+static void BM_exec(benchmark::State& state, const opcode_benchmark benchmark)
+{
+	const std::unique_ptr<chip8> instance = make_chip8();
+	for (auto _ : state)
+	{
+		chip8_exec(instance.get(), benchmark.opcode);
+		if (benchmark.undo != 0)
+		{
+			chip8_exec(instance.get(), benchmark.undo);
+		}
+		benchmark::DoNotOptimize(instance->registers);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+// Arguments: sprite height, x. Sprites at x = 60 also start at y = 28, so they wrap both ways.
+static void BM_screen_draw_sprite(benchmark::State& state)
+{
+	const int height = (int)state.range(0);
+	const int x = (int)state.range(1);
+	const int y = x == 60 ? 28 : 0;
+	const char sprite[15] = {
+		(char)0xF0, (char)0x90, (char)0xF0, (char)0x90, (char)0xF0,
+		(char)0xAA, 0x55, (char)0xAA, 0x55, (char)0xAA,
+		0x0F, 0x3C, 0x7E, (char)0xFF, 0x18
+	};
+	chip8_screen screen{};
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(chip8_screen_draw_sprite(&screen, x, y, sprite, height));
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_screen_draw_sprite)->ArgNames({ "height", "x" })->ArgsProduct({ { 1, 5, 15 }, { 0, 4, 60 } });
+
+static void BM_memory_get_short(benchmark::State& state)
+{
+	const std::unique_ptr<chip8> instance = make_chip8();
+	int address = CHIP8_PROGRAM_LOAD_ADDRESS;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(chip8_memory_get_short(&instance->memory, address));
+		address = (address + 2) & (CHIP8_MEMORY_SIZE - 2);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_memory_get_short);
+
+// Argument: index of the key in the map, the lookup is a linear search
+static void BM_keyboard_map(benchmark::State& state)
+{
+	const std::unique_ptr<chip8> instance = make_chip8();
+	const int key = keyboard_map[state.range(0)];
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(chip8_keyboard_map(&instance->keyboard, key));
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_keyboard_map)->Arg(0)->Arg(CHIP_TOTAL_KEYS - 1);
+
+static void BM_init(benchmark::State& state)
+{
+	const std::unique_ptr<chip8> instance(new chip8);
+	for (auto _ : state)
+	{
+		chip8_init(instance.get());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_init);
+
+int main(int argc, char** argv)
+{
+	for (const opcode_benchmark& benchmark : opcode_benchmarks)
+	{
+		benchmark::RegisterBenchmark((std::string("BM_exec/") + benchmark.name).c_str(), BM_exec, benchmark);
+	}
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+	{
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,353 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "chip8_decoder.h"
+#include "chip8_memory.h"
+
+/*
+	chip8c - ahead-of-time compiler from a Chip-8 ROM to C.
+
+	Usage: chip8c <rom> <output.c>
+
+	Starting at CHIP8_PROGRAM_LOAD_ADDRESS, the control flow of the ROM is followed through
+	jumps, calls, returns and skips to find every reachable basic block. Each block becomes
+	a C function operating on struct chip8, and chip8_aot_run dispatches on PC to them
+	(see chip8_aot.h for how the generated file is used).
+
+	Arithmetic, register, timer and flow control instructions are translated inline.
+	Everything else (drawing, the keyboard, BCD, register dumps...) is executed with chip8_exec.
+	Indirect jumps (Bnnn) end a block, their target is looked up at run time.
+ */
+
+struct chip8c_block
+{
+	unsigned short start;
+	unsigned char length;
+	// Pages of memory (CHIP8_MEMORY_PAGE_SIZE) the block was compiled from
+	unsigned long long pages;
+};
+
+struct chip8c_program
+{
+	struct chip8_memory_image image;
+	struct chip8_memory memory;
+	int rom_end;
+	bool is_leader[CHIP8_MEMORY_SIZE];
+	struct chip8c_block blocks[CHIP8_MEMORY_SIZE];
+	int total_blocks;
+};
+
+static bool chip8c_is_in_rom(const struct chip8c_program* program, const int address)
+{
+	return address >= CHIP8_PROGRAM_LOAD_ADDRESS && address + 1 < program->rom_end;
+}
+
+static struct chip8_instruction chip8c_fetch(const struct chip8c_program* program, const int address)
+{
+	return chip8_decode(chip8_memory_get_short(&program->memory, address));
+}
+
+static bool chip8c_is_skip(const unsigned char operation)
+{
+	switch (operation)
+	{
+		case CHIP8_OP_SE_VX_BYTE:
+		case CHIP8_OP_SNE_VX_BYTE:
+		case CHIP8_OP_SE_VX_VY:
+		case CHIP8_OP_SNE_VX_VY:
+		case CHIP8_OP_SKP_VX:
+		case CHIP8_OP_SKNP_VX:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Instructions after which execution doesn't simply continue with the next one
+static bool chip8c_is_terminator(const unsigned char operation)
+{
+	switch (operation)
+	{
+		case CHIP8_OP_RET:
+		case CHIP8_OP_JP_ADDR:
+		case CHIP8_OP_CALL_ADDR:
+		case CHIP8_OP_JP_V0_ADDR:
+		// moves PC back while no key is down
+		case CHIP8_OP_LD_VX_K:
+		// write memory, maybe the very instructions compiled after them
+		case CHIP8_OP_LD_B_VX:
+		case CHIP8_OP_LD_I_VX:
+			return true;
+		default:
+			return chip8c_is_skip(operation);
+	}
+}
+
+static void chip8c_push(struct chip8c_program* program, int* worklist, int* pending, const int address)
+{
+	if (chip8c_is_in_rom(program, address) && !program->is_leader[address])
+	{
+		program->is_leader[address] = true;
+		worklist[(*pending)++] = address;
+	}
+}
+
+static void chip8c_analyze(struct chip8c_program* program)
+{
+	static int worklist[CHIP8_MEMORY_SIZE];
+	int pending = 0;
+	chip8c_push(program, worklist, &pending, CHIP8_PROGRAM_LOAD_ADDRESS);
+
+	while (pending > 0)
+	{
+		const int start = worklist[--pending];
+		int address = start;
+		int length = 0;
+
+		while (chip8c_is_in_rom(program, address) && length < CHIP8_BLOCK_MAX_INSTRUCTIONS)
+		{
+			// unknown opcodes (data embedded in the code, often) fall through like in the interpreter
+			const struct chip8_instruction instruction = chip8c_fetch(program, address);
+			length++;
+			address += 2;
+
+			if (instruction.operation == CHIP8_OP_JP_ADDR || instruction.operation == CHIP8_OP_CALL_ADDR)
+			{
+				chip8c_push(program, worklist, &pending, instruction.nnn);
+			}
+			if (instruction.operation == CHIP8_OP_CALL_ADDR || instruction.operation == CHIP8_OP_LD_VX_K
+				|| instruction.operation == CHIP8_OP_LD_B_VX || instruction.operation == CHIP8_OP_LD_I_VX)
+			{
+				// where the subroutine returns to, where execution resumes once a key is down,
+				// or where the written pages are checked again before going on
+				chip8c_push(program, worklist, &pending, address);
+			}
+			if (chip8c_is_skip(instruction.operation))
+			{
+				chip8c_push(program, worklist, &pending, address);
+				chip8c_push(program, worklist, &pending, address + 2);
+			}
+			if (chip8c_is_terminator(instruction.operation))
+			{
+				break;
+			}
+			if (length == CHIP8_BLOCK_MAX_INSTRUCTIONS)
+			{
+				chip8c_push(program, worklist, &pending, address);
+			}
+		}
+
+		if (length == 0)
+		{
+			continue;
+		}
+
+		struct chip8c_block* block = &program->blocks[program->total_blocks++];
+		block->start = start;
+		block->length = length;
+		block->pages = 0;
+		for (int page = start / CHIP8_MEMORY_PAGE_SIZE; page <= (address - 1) / CHIP8_MEMORY_PAGE_SIZE; page++)
+		{
+			block->pages |= 1ULL << page;
+		}
+	}
+}
+
+static int chip8c_compare_blocks(const void* a, const void* b)
+{
+	return ((const struct chip8c_block*)a)->start - ((const struct chip8c_block*)b)->start;
+}
+
+// Writes the C statements for one instruction. Returns true when the instruction sets PC itself.
+static bool chip8c_emit_instruction(FILE* out, const int address, const unsigned short opcode)
+{
+	const struct chip8_instruction instruction = chip8_decode(opcode);
+	const int x = instruction.x;
+	const int y = instruction.y;
+	const int next = address + 2;
+
+	switch (instruction.operation)
+	{
+		case CHIP8_OP_JP_ADDR:
+			fprintf(out, "\tchip8->registers.PC = 0x%03X;\n", instruction.nnn);
+			return true;
+		case CHIP8_OP_SE_VX_BYTE:
+			fprintf(out, "\tchip8->registers.PC = V[0x%X] == 0x%02X ? 0x%03X : 0x%03X;\n", x, instruction.kk, next + 2, next);
+			return true;
+		case CHIP8_OP_SNE_VX_BYTE:
+			fprintf(out, "\tchip8->registers.PC = V[0x%X] != 0x%02X ? 0x%03X : 0x%03X;\n", x, instruction.kk, next + 2, next);
+			return true;
+		case CHIP8_OP_SE_VX_VY:
+			fprintf(out, "\tchip8->registers.PC = V[0x%X] == V[0x%X] ? 0x%03X : 0x%03X;\n", x, y, next + 2, next);
+			return true;
+		case CHIP8_OP_SNE_VX_VY:
+			fprintf(out, "\tchip8->registers.PC = V[0x%X] != V[0x%X] ? 0x%03X : 0x%03X;\n", x, y, next + 2, next);
+			return true;
+		case CHIP8_OP_LD_VX_BYTE:
+			fprintf(out, "\tV[0x%X] = 0x%02X;\n", x, instruction.kk);
+			return false;
+		case CHIP8_OP_ADD_VX_BYTE:
+			fprintf(out, "\tV[0x%X] += 0x%02X;\n", x, instruction.kk);
+			return false;
+		case CHIP8_OP_LD_VX_VY:
+			fprintf(out, "\tV[0x%X] = V[0x%X];\n", x, y);
+			return false;
+		case CHIP8_OP_OR_VX_VY:
+			fprintf(out, "\tV[0x%X] |= V[0x%X];\n", x, y);
+			return false;
+		case CHIP8_OP_AND_VX_VY:
+			fprintf(out, "\tV[0x%X] &= V[0x%X];\n", x, y);
+			return false;
+		case CHIP8_OP_XOR_VX_VY:
+			fprintf(out, "\tV[0x%X] ^= V[0x%X];\n", x, y);
+			return false;
+		case CHIP8_OP_ADD_VX_VY:
+			fprintf(out, "\t{\n\t\tconst unsigned short sum = V[0x%X] + V[0x%X];\n", x, y);
+			fprintf(out, "\t\tV[0x%X] = (unsigned char)sum;\n", x);
+			fprintf(out, "\t\tV[0xF] = sum > 255;\n\t}\n");
+			return false;
+		case CHIP8_OP_SUB_VX_VY:
+			fprintf(out, "\tV[0xF] = V[0x%X] > V[0x%X];\n", x, y);
+			fprintf(out, "\tV[0x%X] -= V[0x%X];\n", x, y);
+			return false;
+		case CHIP8_OP_SHR_VX:
+			fprintf(out, "\tV[0xF] = V[0x%X] & 1;\n", x);
+			fprintf(out, "\tV[0x%X] >>= 1;\n", x);
+			return false;
+		case CHIP8_OP_SUBN_VX_VY:
+			fprintf(out, "\tV[0xF] = V[0x%X] < V[0x%X];\n", x, y);
+			fprintf(out, "\tV[0x%X] = V[0x%X] - V[0x%X];\n", x, y, x);
+			return false;
+		case CHIP8_OP_SHL_VX:
+			// VF is cleared first, like the interpreter does, which matters for 8FxE
+			fprintf(out, "\tV[0xF] = 0;\n");
+			fprintf(out, "\tV[0xF] = V[0x%X] >> 7;\n", x);
+			fprintf(out, "\tV[0x%X] <<= 1;\n", x);
+			return false;
+		case CHIP8_OP_LD_I_ADDR:
+			fprintf(out, "\tchip8->registers.I = 0x%03X;\n", instruction.nnn);
+			return false;
+		case CHIP8_OP_LD_VX_DT:
+			fprintf(out, "\tV[0x%X] = chip8->registers.delay_timer;\n", x);
+			return false;
+		case CHIP8_OP_LD_DT_VX:
+			fprintf(out, "\tchip8->registers.delay_timer = V[0x%X];\n", x);
+			return false;
+		case CHIP8_OP_LD_ST_VX:
+			fprintf(out, "\tchip8->registers.sound_timer = V[0x%X];\n", x);
+			return false;
+		case CHIP8_OP_ADD_I_VX:
+			fprintf(out, "\tchip8->registers.I += V[0x%X];\n", x);
+			return false;
+		default:
+			// handlers expect PC to point past the instruction already, as chip8_step leaves it
+			fprintf(out, "\tchip8->registers.PC = 0x%03X;\n", next);
+			fprintf(out, "\tchip8_exec(chip8, 0x%04X);\n", opcode);
+			return chip8c_is_terminator(instruction.operation);
+	}
+}
+
+static void chip8c_emit_block(FILE* out, const struct chip8c_program* program, const struct chip8c_block* block)
+{
+	fprintf(out, "static void chip8_aot_block_%03X(struct chip8* chip8)\n{\n", block->start);
+
+	int address = block->start;
+	bool sets_pc = false;
+	for (int i = 0; i < block->length; i++)
+	{
+		const unsigned short opcode = chip8_memory_get_short(&program->memory, address);
+		fprintf(out, "\t// 0x%03X: %04X\n", address, opcode);
+		sets_pc = chip8c_emit_instruction(out, address, opcode);
+		address += 2;
+	}
+
+	if (!sets_pc)
+	{
+		fprintf(out, "\tchip8->registers.PC = 0x%03X;\n", address);
+	}
+	fprintf(out, "}\n\n");
+}
+
+static void chip8c_emit(FILE* out, const struct chip8c_program* program, const char* rom_name)
+{
+	fprintf(out, "// Generated by chip8c from %s, do not edit.\n", rom_name);
+	fprintf(out, "#include \"chip8.h\"\n#include \"chip8_aot.h\"\n\n");
+	fprintf(out, "#define V chip8->registers.V\n\n");
+
+	const int rom_size = program->rom_end - CHIP8_PROGRAM_LOAD_ADDRESS;
+	fprintf(out, "const char chip8_aot_rom[] = {");
+	for (int i = 0; i < rom_size; i++)
+	{
+		fprintf(out, "%s(char)0x%02X,", i % 12 == 0 ? "\n\t" : " ", program->image.memory[CHIP8_PROGRAM_LOAD_ADDRESS + i]);
+	}
+	fprintf(out, "\n};\n\nconst size_t chip8_aot_rom_size = %d;\n\n", rom_size);
+
+	for (int i = 0; i < program->total_blocks; i++)
+	{
+		chip8c_emit_block(out, program, &program->blocks[i]);
+	}
+
+	fprintf(out, "void chip8_aot_run(struct chip8* chip8, int instructions)\n{\n");
+	fprintf(out, "\twhile (instructions > 0)\n\t{\n");
+	fprintf(out, "\t\tconst unsigned long long written = chip8->memory.written_pages;\n");
+	fprintf(out, "\t\tswitch (chip8->registers.PC)\n\t\t{\n");
+	for (int i = 0; i < program->total_blocks; i++)
+	{
+		const struct chip8c_block* block = &program->blocks[i];
+		fprintf(out, "\t\t\tcase 0x%03X:\n", block->start);
+		fprintf(out, "\t\t\t\tif ((written & 0x%016llXULL) == 0 && instructions >= %d)\n", block->pages, block->length);
+		fprintf(out, "\t\t\t\t{\n\t\t\t\t\tchip8_aot_block_%03X(chip8);\n", block->start);
+		fprintf(out, "\t\t\t\t\tinstructions -= %d;\n\t\t\t\t\tcontinue;\n\t\t\t\t}\n", block->length);
+		fprintf(out, "\t\t\t\tbreak;\n");
+	}
+	fprintf(out, "\t\t\tdefault:\n\t\t\t\tbreak;\n\t\t}\n\n");
+	fprintf(out, "\t\t// not compiled, overwritten, or longer than the remaining budget\n");
+	fprintf(out, "\t\tchip8_step(chip8);\n\t\tinstructions -= 1;\n\t}\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printf("Usage: %s <rom> <output.c>\n", argv[0]);
+		return -1;
+	}
+
+	static struct chip8c_program program;
+
+	FILE* rom = fopen(argv[1], "rb");
+	if (!rom)
+	{
+		printf("Failed to open the file %s\n", argv[1]);
+		return -1;
+	}
+
+	const size_t size = fread(&program.image.memory[CHIP8_PROGRAM_LOAD_ADDRESS], 1, CHIP8_MEMORY_SIZE - CHIP8_PROGRAM_LOAD_ADDRESS, rom);
+	fclose(rom);
+	// the same limit as chip8_load, which the generated ROM is loaded with
+	if (size + CHIP8_PROGRAM_LOAD_ADDRESS >= CHIP8_MEMORY_SIZE)
+	{
+		printf("The ROM %s is too large, at most %d bytes fit\n", argv[1], CHIP8_MEMORY_SIZE - CHIP8_PROGRAM_LOAD_ADDRESS - 1);
+		return -1;
+	}
+	chip8_memory_map(&program.memory, &program.image);
+	program.rom_end = CHIP8_PROGRAM_LOAD_ADDRESS + (int)size;
+
+	chip8c_analyze(&program);
+	qsort(program.blocks, program.total_blocks, sizeof(struct chip8c_block), chip8c_compare_blocks);
+
+	FILE* out = fopen(argv[2], "w");
+	if (!out)
+	{
+		printf("Failed to create the file %s\n", argv[2]);
+		return -1;
+	}
+
+	chip8c_emit(out, &program, argv[1]);
+	fclose(out);
+
+	printf("%d blocks compiled\n", program.total_blocks);
+	return 0;
+}
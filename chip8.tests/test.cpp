@@ -1,15 +1,25 @@
 #include "pch.h"
 extern "C" {
-#include "SDL.h"
 #include "chip8.h"
+#ifdef CHIP8_TEST_AOT
+#include "chip8_aot.h"
+#endif
+#include "chip8_frame_buffer.h"
+#include "chip8_input_log.h"
+#include "chip8_lockstep.h"
+#include "chip8_platform.h"
+#include "chip8_rewind.h"
+#include "chip8_scheduler.h"
+#include "chip8_script.h"
+#include "chip8_state.h"
 }
 
 const char keyboard_map[CHIP_TOTAL_KEYS] = {
-	SDLK_0, SDLK_1, SDLK_2, SDLK_3, SDLK_4, SDLK_5, SDLK_6, SDLK_7,
-	SDLK_8, SDLK_9, SDLK_a, SDLK_b, SDLK_c, SDLK_d, SDLK_e, SDLK_f
+	'0', '1', '2', '3', '4', '5', '6', '7',
+	'8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
 };
 
-const char chip8_default_character_set[] = {
+const unsigned char chip8_default_character_set[] = {
 	0xF0,0x90,0x90,0x90,0xF0,	// 0
 	0x20,0x60,0x20,0x20,0x70,	// 1
 	0xF0,0x10,0xF0,0x80,0xF0,	// 2
@@ -32,8 +42,10 @@ TEST(Init, load_character_set) {
 
 	chip8 chip8{};
 	chip8_init(&chip8);
-	const int result = memcmp(chip8.memory.memory, chip8_default_character_set, sizeof(chip8_default_character_set));
-	EXPECT_EQ(result, 0);
+	for (int i = 0; i < (int)sizeof(chip8_default_character_set); i++)
+	{
+		EXPECT_EQ(chip8_memory_get(&chip8.memory, CHIP8_CHARACTER_SET_LOAD_ADDRESS + i), chip8_default_character_set[i]);
+	}
 }
 
 TEST(Keyboard, load_keyboard_map) {
@@ -94,18 +106,18 @@ TEST(Instructions, CLS) {
 	chip8 chip8{};
 	chip8_init(&chip8);
 
-	chip8.screen.pixels[0][1] = true;
-	chip8.screen.pixels[3][60] = true;
-	chip8.screen.pixels[5][23] = true;
-	chip8.screen.pixels[2][1] = true;
-	chip8.screen.pixels[0][33] = true;
+	chip8_screen_set(&chip8.screen, 1, 0);
+	chip8_screen_set(&chip8.screen, 60, 3);
+	chip8_screen_set(&chip8.screen, 23, 5);
+	chip8_screen_set(&chip8.screen, 1, 2);
+	chip8_screen_set(&chip8.screen, 33, 0);
 
 	chip8_exec(&chip8, 0x00E0);
-	EXPECT_FALSE(chip8.screen.pixels[0][1]);
-	EXPECT_FALSE(chip8.screen.pixels[3][60]);
-	EXPECT_FALSE(chip8.screen.pixels[5][23]);
-	EXPECT_FALSE(chip8.screen.pixels[2][1] );
-	EXPECT_FALSE(chip8.screen.pixels[0][33]);
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 1, 0));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 60, 3));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 23, 5));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 1, 2));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 33, 0));
 }
 
 // 00EE - RET
@@ -474,6 +486,37 @@ TEST(Instructions, RND_Vx_byte) {
 	EXPECT_NE(chip8.registers.V[0x00], 0x11);
 }
 
+TEST(Instructions, RND_Vx_byte_is_reproducible_from_the_seed) {
+	chip8 first{};
+	chip8 second{};
+	chip8_init(&first);
+	chip8_init(&second);
+	chip8_seed(&first, 1234);
+	chip8_seed(&second, 1234);
+
+	bool seen[256] = { false };
+	int distinct = 0;
+	for (int i = 0; i < 4096; i++)
+	{
+		chip8_exec(&first, 0xC0FF);
+		chip8_exec(&second, 0xC0FF);
+		ASSERT_EQ(first.registers.V[0x00], second.registers.V[0x00]);
+
+		distinct += !seen[first.registers.V[0x00]];
+		seen[first.registers.V[0x00]] = true;
+	}
+
+	// every byte, including 0xFF, comes up
+	EXPECT_EQ(distinct, 256);
+
+	chip8_seed(&second, 4321);
+	chip8_exec(&first, 0xC0FF);
+	chip8_exec(&second, 0xC0FF);
+	chip8_exec(&first, 0xC1FF);
+	chip8_exec(&second, 0xC1FF);
+	EXPECT_FALSE(first.registers.V[0x00] == second.registers.V[0x00] && first.registers.V[0x01] == second.registers.V[0x01]);
+}
+
 // Dxyn - DRW Vx, Vy, nibble
 // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
 // The interpreter reads n bytes from memory, starting at the address stored in I.
@@ -490,30 +533,56 @@ TEST(Instructions, DRW_Vx_Vy_nibble) {
 	chip8_exec(&chip8, 0xD005);
 
 
-	EXPECT_TRUE(chip8.screen.pixels[0][0]);
-	EXPECT_TRUE(chip8.screen.pixels[0][1]);
-	EXPECT_TRUE(chip8.screen.pixels[0][2]);
-	EXPECT_TRUE(chip8.screen.pixels[0][3]);
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 0, 0));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 1, 0));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 2, 0));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 3, 0));
 
-	EXPECT_TRUE(chip8.screen.pixels[1][0]);
-	EXPECT_FALSE(chip8.screen.pixels[1][1]);
-	EXPECT_FALSE(chip8.screen.pixels[1][2]);
-	EXPECT_TRUE(chip8.screen.pixels[1][3]);
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 0, 1));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 1, 1));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 2, 1));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 3, 1));
 
-	EXPECT_TRUE(chip8.screen.pixels[2][0]);
-	EXPECT_FALSE(chip8.screen.pixels[2][1]);
-	EXPECT_FALSE(chip8.screen.pixels[2][2]);
-	EXPECT_TRUE(chip8.screen.pixels[2][3]);
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 0, 2));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 1, 2));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 2, 2));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 3, 2));
 
-	EXPECT_TRUE(chip8.screen.pixels[3][0]);
-	EXPECT_FALSE(chip8.screen.pixels[3][1]);
-	EXPECT_FALSE(chip8.screen.pixels[3][2]);
-	EXPECT_TRUE(chip8.screen.pixels[3][3]);
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 0, 3));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 1, 3));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 2, 3));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 3, 3));
 
-	EXPECT_TRUE(chip8.screen.pixels[4][0]);
-	EXPECT_TRUE(chip8.screen.pixels[4][1]);
-	EXPECT_TRUE(chip8.screen.pixels[4][2]);
-	EXPECT_TRUE(chip8.screen.pixels[4][3]);
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 0, 4));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 1, 4));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 2, 4));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 3, 4));
+}
+
+TEST(Instructions, DRW_Vx_Vy_nibble_wraps_and_collides) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+
+	chip8.registers.I = 0x00;
+	chip8.registers.V[0x00] = 62;
+	chip8.registers.V[0x01] = 30;
+
+	// the top row of "0" is 0xF0, so it covers columns 62, 63, 0 and 1
+	chip8_exec(&chip8, 0xD015);
+	EXPECT_EQ(chip8.registers.V[0x0F], 0x00);
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 62, 30));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 63, 30));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 0, 30));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 1, 30));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 2, 30));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 62, 2));
+	EXPECT_TRUE(chip8_screen_is_set(&chip8.screen, 1, 2));
+
+	// drawing the same sprite again erases it and reports the collision
+	chip8_exec(&chip8, 0xD015);
+	EXPECT_EQ(chip8.registers.V[0x0F], 0x01);
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 62, 30));
+	EXPECT_FALSE(chip8_screen_is_set(&chip8.screen, 1, 2));
 }
 
 // Ex9E - SKP Vx
@@ -569,9 +638,44 @@ TEST(Instructions, LD_Vx_DT) {
 
 // Fx0A - LD Vx, K
 // Wait for a key press, store the value of the key in Vx.
-//! I don't this there's a way to unit test this one
+TEST(Instructions, LD_Vx_K) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+	const char program[] = { (char)0xF3, 0x0A };
+	chip8_load(&chip8, program, sizeof(program));
 
+	// no key down, the instruction keeps executing
+	chip8_run(&chip8, 3);
+	EXPECT_EQ(chip8.registers.PC, 0x200);
 
+	chip8_keyboard_down(&chip8.keyboard, 0x0B);
+	chip8_step(&chip8);
+	EXPECT_EQ(chip8.registers.V[0x03], 0x0B);
+	EXPECT_EQ(chip8.registers.PC, 0x202);
+}
+
+TEST(Instructions, LD_Vx_K_waits_for_a_new_press) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+	const char program[] = { (char)0xF3, 0x0A };
+	chip8_load(&chip8, program, sizeof(program));
+
+	// held since before the wait, and repeating while held
+	chip8_keyboard_down(&chip8.keyboard, 0x04);
+	chip8_run(&chip8, 2);
+	chip8_keyboard_down(&chip8.keyboard, 0x04);
+	chip8_run(&chip8, 2);
+	EXPECT_EQ(chip8.registers.PC, 0x200);
+	EXPECT_TRUE(chip8.keyboard.waiting);
+
+	// pressed and released between two executions, the press is not lost
+	chip8_keyboard_down(&chip8.keyboard, 0x09);
+	chip8_keyboard_up(&chip8.keyboard, 0x09);
+	chip8_step(&chip8);
+	EXPECT_EQ(chip8.registers.V[0x03], 0x09);
+	EXPECT_EQ(chip8.registers.PC, 0x202);
+	EXPECT_FALSE(chip8.keyboard.waiting);
+}
 
 // Fx15 - LD DT, Vx
 // Set delay timer = Vx.
@@ -636,9 +740,9 @@ TEST(Instructions, LD_B_Vx) {
 	chip8.registers.V[0x00] = 134;
 
 	chip8_exec(&chip8, 0xF033);
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I] , 1);
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I + 1], 3);
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I + 2], 4);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I), 1);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I + 1), 3);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I + 2), 4);
 }
 
 // Fx55 - LD [I], Vx
@@ -658,12 +762,12 @@ TEST(Instructions, LD__I__Vx) {
 
 	chip8_exec(&chip8, 0xF555);
 
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I], 0x00);
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I + 1], 0x01);
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I + 2], 0x02);
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I + 3], 0x03);
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I + 4], 0x04);
-	EXPECT_EQ(chip8.memory.memory[chip8.registers.I + 5], 0x05);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I), 0x00);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I + 1), 0x01);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I + 2), 0x02);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I + 3), 0x03);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I + 4), 0x04);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, chip8.registers.I + 5), 0x05);
 }
 
 // Fx65 - LD Vx, [I]
@@ -675,12 +779,12 @@ TEST(Instructions, LD_Vx__I) {
 
 	chip8.registers.I = 0x200;
 
-	chip8.memory.memory[chip8.registers.I] = 0x00;
-	chip8.memory.memory[chip8.registers.I + 1] = 0x01;
-	chip8.memory.memory[chip8.registers.I + 2] = 0x02;
-	chip8.memory.memory[chip8.registers.I + 3] = 0x03;
-	chip8.memory.memory[chip8.registers.I + 4] = 0x04;
-	chip8.memory.memory[chip8.registers.I + 5] = 0x05;
+	chip8_memory_set(&chip8.memory, chip8.registers.I, 0x00);
+	chip8_memory_set(&chip8.memory, chip8.registers.I + 1, 0x01);
+	chip8_memory_set(&chip8.memory, chip8.registers.I + 2, 0x02);
+	chip8_memory_set(&chip8.memory, chip8.registers.I + 3, 0x03);
+	chip8_memory_set(&chip8.memory, chip8.registers.I + 4, 0x04);
+	chip8_memory_set(&chip8.memory, chip8.registers.I + 5, 0x05);
 
 	chip8_exec(&chip8, 0xF565);
 	EXPECT_EQ(chip8.registers.V[0], 0x00);
@@ -689,4 +793,938 @@ TEST(Instructions, LD_Vx__I) {
 	EXPECT_EQ(chip8.registers.V[3], 0x03);
 	EXPECT_EQ(chip8.registers.V[4], 0x04);
 	EXPECT_EQ(chip8.registers.V[5], 0x05);
-}
\ No newline at end of file
+}
+
+TEST(Step, fetches_and_executes_instruction_at_PC) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+
+	const char program[] = { 0x60, 0x55, 0x71, 0x02 };
+	chip8_load(&chip8, program, sizeof(program));
+
+	chip8_step(&chip8);
+	EXPECT_EQ(chip8.registers.V[0x00], 0x55);
+	EXPECT_EQ(chip8.registers.PC, CHIP8_PROGRAM_LOAD_ADDRESS + 2);
+
+	chip8_step(&chip8);
+	EXPECT_EQ(chip8.registers.V[0x01], 0x02);
+	EXPECT_EQ(chip8.registers.PC, CHIP8_PROGRAM_LOAD_ADDRESS + 4);
+}
+
+TEST(Timers, tick_decrements_timers_once) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+
+	chip8.registers.delay_timer = 0x02;
+	chip8.registers.sound_timer = 0x01;
+
+	chip8_tick_timers(&chip8);
+	EXPECT_EQ(chip8.registers.delay_timer, 0x01);
+	EXPECT_EQ(chip8.registers.sound_timer, 0x00);
+
+	chip8_tick_timers(&chip8);
+	EXPECT_EQ(chip8.registers.delay_timer, 0x00);
+	EXPECT_EQ(chip8.registers.sound_timer, 0x00);
+}
+
+TEST(Clock, ticks_timers_every_instructions_per_tick_however_the_run_is_split) {
+	// 0x200: JP 0x200
+	const char program[] = { 0x12, 0x00 };
+	chip8 whole{};
+	chip8 split{};
+	chip8_init(&whole);
+	chip8_init(&split);
+	chip8_load(&whole, program, sizeof(program));
+	chip8_load(&split, program, sizeof(program));
+	chip8_set_instructions_per_tick(&whole, 7);
+	chip8_set_instructions_per_tick(&split, 7);
+	whole.registers.delay_timer = 0xFF;
+	split.registers.delay_timer = 0xFF;
+
+	chip8_advance(&whole, 100);
+	for (int i = 0; i < 100; i += 3)
+	{
+		chip8_advance(&split, 100 - i < 3 ? 100 - i : 3);
+	}
+
+	EXPECT_EQ(whole.clock.instructions, 100u);
+	EXPECT_EQ(whole.clock.ticks, 14u);
+	EXPECT_EQ(whole.clock.until_tick, 5);
+	EXPECT_EQ(whole.registers.delay_timer, 0xFF - 14);
+	EXPECT_EQ(split.clock.ticks, whole.clock.ticks);
+	EXPECT_EQ(split.clock.until_tick, whole.clock.until_tick);
+	EXPECT_EQ(split.registers.delay_timer, whole.registers.delay_timer);
+
+	chip8_destroy(&whole);
+	chip8_destroy(&split);
+}
+
+TEST(Clock, fast_forwards_idle_loops_with_the_same_result) {
+	const char program[] = {
+		0x61, 0x14,			// 0x200: LD V1, 0x14
+		(char)0xF1, 0x15,	// 0x202: LD DT, V1
+		(char)0xF0, 0x07,	// 0x204: LD V0, DT
+		0x30, 0x00,			// 0x206: SE V0, 0x00
+		0x12, 0x04,			// 0x208: JP 0x204
+		0x72, 0x01,			// 0x20A: ADD V2, 0x01
+		0x12, 0x0C,			// 0x20C: JP 0x20C
+	};
+	chip8 fast{};
+	chip8 slow{};
+	chip8_init(&fast);
+	chip8_init(&slow);
+	chip8_load(&fast, program, sizeof(program));
+	chip8_load(&slow, program, sizeof(program));
+	chip8_set_instructions_per_tick(&fast, 7);
+
+	for (int tick = 0; tick < 40; tick++)
+	{
+		// odd sizes so runs stop partway through the wait loop
+		chip8_advance(&fast, 4);
+		chip8_advance(&fast, 3);
+		chip8_run(&slow, 7);
+		chip8_tick_timers(&slow);
+		ASSERT_EQ(memcmp(&fast.registers, &slow.registers, sizeof(fast.registers)), 0) << "tick " << tick;
+		EXPECT_EQ(chip8_activity(&fast), chip8_activity(&slow));
+	}
+
+	EXPECT_EQ(fast.registers.V[2], 1);
+	EXPECT_EQ(chip8_activity(&fast), CHIP8_HALTED);
+	EXPECT_GT(fast.clock.idle_instructions, 150u);
+
+	chip8_destroy(&fast);
+	chip8_destroy(&slow);
+}
+
+TEST(Clock, waiting_for_a_key_is_idle) {
+	// 0x200: LD V3, K
+	const char program[] = { (char)0xF3, 0x0A };
+	chip8 chip8{};
+	chip8_init(&chip8);
+	chip8_load(&chip8, program, sizeof(program));
+
+	// the wait starts when the instruction first runs, up to the first tick
+	EXPECT_EQ(chip8_activity(&chip8), CHIP8_RUNNING);
+	chip8_advance(&chip8, 50);
+	EXPECT_EQ(chip8_activity(&chip8), CHIP8_WAITING_KEY);
+	EXPECT_EQ(chip8.registers.PC, CHIP8_PROGRAM_LOAD_ADDRESS);
+	EXPECT_EQ(chip8.clock.idle_instructions, 40u);
+
+	chip8_keyboard_down(&chip8.keyboard, 0xB);
+	EXPECT_EQ(chip8_activity(&chip8), CHIP8_RUNNING);
+	chip8_advance(&chip8, 1);
+	EXPECT_EQ(chip8.registers.V[3], 0xB);
+
+	chip8_destroy(&chip8);
+}
+
+TEST(Decoder, decode_extracts_operands) {
+	const chip8_instruction instruction = chip8_decode(0xD125);
+
+	EXPECT_EQ(instruction.operation, CHIP8_OP_DRW_VX_VY_NIBBLE);
+	EXPECT_EQ(instruction.x, 0x01);
+	EXPECT_EQ(instruction.y, 0x02);
+	EXPECT_EQ(instruction.n, 0x05);
+	EXPECT_EQ(instruction.kk, 0x25);
+	EXPECT_EQ(instruction.nnn, 0x125);
+
+	EXPECT_EQ(chip8_decode(0x8126).operation, CHIP8_OP_SHR_VX);
+	EXPECT_EQ(chip8_decode(0x8128).operation, CHIP8_OP_UNKNOWN);
+	EXPECT_EQ(chip8_decode(0xF165).operation, CHIP8_OP_LD_VX_I);
+}
+
+TEST(Decoder, self_modifying_code_invalidates_cache) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+
+	const char program[] = {
+		(char)0xA2, 0x08,	// LD I, 0x208
+		0x60, 0x62,			// LD V0, 0x62
+		0x61, 0x77,			// LD V1, 0x77
+		(char)0xF1, 0x55,	// LD [I], V1 - overwrites the instruction at 0x208
+		0x62, 0x11,			// LD V2, 0x11
+	};
+	chip8_load(&chip8, program, sizeof(program));
+
+	// decode the instruction at 0x208 before it is overwritten
+	chip8.registers.PC = 0x208;
+	chip8_step(&chip8);
+	EXPECT_EQ(chip8.registers.V[0x02], 0x11);
+
+	chip8.registers.PC = 0x200;
+	for (int i = 0; i < 5; i++)
+	{
+		chip8_step(&chip8);
+	}
+
+	EXPECT_EQ(chip8.registers.V[0x02], 0x77);
+}
+
+TEST(Run, executes_requested_number_of_instructions) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+
+	const char program[] = {
+		0x60, 0x01,			// LD V0, 0x01
+		0x70, 0x01,			// ADD V0, 0x01
+		0x12, 0x02,			// JP 0x202
+	};
+	chip8_load(&chip8, program, sizeof(program));
+
+	chip8_run(&chip8, 7);
+	EXPECT_EQ(chip8.registers.V[0x00], 0x04);
+	EXPECT_EQ(chip8.registers.PC, 0x202);
+}
+
+static const char block_test_program[] = {
+	0x60, 0x05,			// 0x200: LD V0, 0x05
+	0x70, 0x03,			// 0x202: ADD V0, 0x03
+	(char)0xA0, 0x00,	// 0x204: LD I, 0x000
+	(char)0xD0, 0x15,	// 0x206: DRW V0, V1, 5
+	0x61, 0x03,			// 0x208: LD V1, 0x03
+	(char)0xF1, 0x15,	// 0x20A: LD DT, V1
+	(char)0xF2, 0x07,	// 0x20C: LD V2, DT
+	0x32, 0x00,			// 0x20E: SE V2, 0x00
+	0x12, 0x0C,			// 0x210: JP 0x20C
+	0x63, 0x01,			// 0x212: LD V3, 0x01
+	0x12, 0x14,			// 0x214: JP 0x214
+};
+
+static void run_block_test_program(chip8* chip8, const chip8_engine engine, const int instructions_per_frame)
+{
+	chip8_init(chip8);
+	chip8_load(chip8, block_test_program, sizeof(block_test_program));
+	chip8_set_engine(chip8, engine);
+
+	for (int frame = 0; frame < 6; frame++)
+	{
+		chip8_run(chip8, instructions_per_frame);
+		chip8_tick_timers(chip8);
+	}
+}
+
+TEST(Blocks, matches_interpreter) {
+	for (int instructions_per_frame = 1; instructions_per_frame < 12; instructions_per_frame++)
+	{
+		chip8 interpreter{};
+		chip8 blocks{};
+		run_block_test_program(&interpreter, CHIP8_ENGINE_INTERPRETER, instructions_per_frame);
+		run_block_test_program(&blocks, CHIP8_ENGINE_BLOCKS, instructions_per_frame);
+
+		EXPECT_EQ(memcmp(&interpreter.registers, &blocks.registers, sizeof(interpreter.registers)), 0);
+		EXPECT_EQ(memcmp(&interpreter.screen, &blocks.screen, sizeof(interpreter.screen)), 0);
+
+		chip8_destroy(&interpreter);
+		chip8_destroy(&blocks);
+	}
+}
+
+TEST(Blocks, fuses_superinstructions) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+	ASSERT_TRUE(chip8_set_engine(&chip8, CHIP8_ENGINE_BLOCKS));
+	chip8_load(&chip8, block_test_program, sizeof(block_test_program));
+
+	const chip8_block* block = chip8_block_cache_fetch(chip8.block_cache, &chip8.decode_cache, &chip8.memory, 0x200);
+	ASSERT_EQ(block->length, 5);
+	EXPECT_EQ(block->guest_instructions, 9);
+
+	EXPECT_EQ(block->instructions[0].operation, CHIP8_OP_LD_VX_BYTE);
+	EXPECT_EQ(block->instructions[0].kk, 0x08);
+	EXPECT_EQ(block->instructions[1].operation, CHIP8_OP_LD_I_DRW);
+	EXPECT_EQ(block->instructions[4].operation, CHIP8_OP_WAIT_DT);
+	EXPECT_EQ(block->instructions[4].nnn, 0x20C);
+
+	chip8_destroy(&chip8);
+}
+
+TEST(Blocks, store_into_own_block) {
+	const char program[] = {
+		0x60, 0x12,			// 0x200: LD V0, 0x12
+		0x61, 0x06,			// 0x202: LD V1, 0x06
+		(char)0xA2, 0x06,	// 0x204: LD I, 0x206
+		(char)0xF1, 0x55,	// 0x206: LD [I], V1, overwrites itself with JP 0x206
+		0x62, 0x01,			// 0x208: LD V2, 0x01
+	};
+	chip8 chip8{};
+	chip8_init(&chip8);
+	ASSERT_TRUE(chip8_set_engine(&chip8, CHIP8_ENGINE_BLOCKS));
+	chip8_load(&chip8, program, sizeof(program));
+
+	// the store clears the block cache while the block is running
+	chip8_run(&chip8, 4);
+	EXPECT_EQ(chip8.registers.PC, 0x208);
+	EXPECT_EQ(chip8.registers.V[0x02], 0x00);
+	EXPECT_EQ(chip8_memory_get_short(&chip8.memory, 0x206), 0x1206);
+
+	chip8_destroy(&chip8);
+}
+
+static const char jit_test_program[] = {
+	0x60, (char)0xF0,	// 0x200: LD V0, 0xF0
+	0x61, 0x25,			// 0x202: LD V1, 0x25
+	(char)0x80, 0x14,	// 0x204: ADD V0, V1
+	(char)0x82, 0x10,	// 0x206: LD V2, V1
+	(char)0x82, 0x05,	// 0x208: SUB V2, V0
+	(char)0x83, 0x27,	// 0x20A: SUBN V3, V2
+	(char)0x84, 0x26,	// 0x20C: SHR V4, V2
+	(char)0x85, 0x3E,	// 0x20E: SHL V5, V3
+	(char)0x86, 0x41,	// 0x210: OR V6, V4
+	(char)0x86, 0x52,	// 0x212: AND V6, V5
+	(char)0x87, 0x13,	// 0x214: XOR V7, V1
+	(char)0xA3, 0x00,	// 0x216: LD I, 0x300
+	(char)0xF7, 0x1E,	// 0x218: ADD I, V7
+	(char)0xF1, 0x18,	// 0x21A: LD ST, V1
+	(char)0xF0, 0x07,	// 0x21C: LD V0, DT
+	(char)0xF3, 0x15,	// 0x21E: LD DT, V3
+	0x78, 0x07,			// 0x220: ADD V8, 0x07
+	0x38, 0x00,			// 0x222: SE V8, 0x00
+	0x12, 0x04,			// 0x224: JP 0x204
+	(char)0x8F, 0x0E,	// 0x226: SHL VF
+	0x12, 0x28,			// 0x228: JP 0x228
+};
+
+TEST(Jit, matches_interpreter) {
+	chip8 interpreter{};
+	chip8_init(&interpreter);
+	chip8 jit{};
+	chip8_init(&jit);
+	if (!chip8_set_engine(&jit, CHIP8_ENGINE_JIT))
+	{
+		GTEST_SKIP() << "JIT not supported on this host";
+	}
+
+	chip8_load(&interpreter, jit_test_program, sizeof(jit_test_program));
+	chip8_load(&jit, jit_test_program, sizeof(jit_test_program));
+
+	for (int frame = 0; frame < 200; frame++)
+	{
+		chip8_run(&interpreter, 7);
+		chip8_tick_timers(&interpreter);
+		chip8_run(&jit, 7);
+		chip8_tick_timers(&jit);
+
+		ASSERT_EQ(memcmp(&interpreter.registers, &jit.registers, sizeof(interpreter.registers)), 0) << "frame " << frame;
+	}
+
+	chip8_destroy(&jit);
+}
+
+TEST(Jit, matches_interpreter_on_block_test_program) {
+	for (int instructions_per_frame = 1; instructions_per_frame < 12; instructions_per_frame++)
+	{
+		chip8 interpreter{};
+		chip8 jit{};
+		run_block_test_program(&interpreter, CHIP8_ENGINE_INTERPRETER, instructions_per_frame);
+		run_block_test_program(&jit, CHIP8_ENGINE_JIT, instructions_per_frame);
+
+		EXPECT_EQ(memcmp(&interpreter.registers, &jit.registers, sizeof(interpreter.registers)), 0);
+		EXPECT_EQ(memcmp(&interpreter.screen, &jit.screen, sizeof(interpreter.screen)), 0);
+		chip8_destroy(&jit);
+	}
+}
+
+TEST(Jit, self_modifying_code_invalidates_compiled_code) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+	if (!chip8_set_engine(&chip8, CHIP8_ENGINE_JIT))
+	{
+		GTEST_SKIP() << "JIT not supported on this host";
+	}
+
+	const char program[] = {
+		0x70, 0x01,			// 0x200: ADD V0, 0x01
+		0x60, 0x71,			// 0x202: LD V0, 0x71
+		(char)0xA2, 0x00,	// 0x204: LD I, 0x200
+		(char)0xF0, 0x55,	// 0x206: LD [I], V0 - turns 0x200 into ADD V1, 0x01
+		0x12, 0x00,			// 0x208: JP 0x200
+	};
+	chip8_load(&chip8, program, sizeof(program));
+
+	chip8_run(&chip8, 4);
+	EXPECT_EQ(chip8_memory_get(&chip8.memory, 0x200), 0x71);
+
+	// 0x200 is now ADD V1, 0x01
+	chip8_run(&chip8, 2);
+	EXPECT_EQ(chip8.registers.V[0x00], 0x71);
+	EXPECT_EQ(chip8.registers.V[0x01], 0x01);
+
+	chip8_destroy(&chip8);
+}
+
+#ifdef CHIP8_TEST_AOT
+// chip8.tests/self_modifying.ch8, compiled by chip8c at build time:
+//	0x200: LD I, 0x208
+//	0x202: LD V0, 0x62
+//	0x204: LD V1, 0x77
+//	0x206: LD [I], V1 - turns 0x208 into LD V2, 0x77
+//	0x208: LD V2, 0x11
+//	0x20A: JP 0x20A
+TEST(Aot, matches_interpreter_on_self_modifying_code) {
+	chip8 compiled{};
+	chip8 interpreted{};
+	chip8_init(&compiled);
+	chip8_init(&interpreted);
+	chip8_load(&compiled, chip8_aot_rom, chip8_aot_rom_size);
+	chip8_load(&interpreted, chip8_aot_rom, chip8_aot_rom_size);
+
+	// runs of at least a whole block, so the compiled code is used rather than the interpreter
+	for (int i = 0; i < 4; i++) {
+		chip8_aot_run(&compiled, 50);
+		chip8_run(&interpreted, 50);
+		EXPECT_EQ(memcmp(compiled.registers.V, interpreted.registers.V, sizeof(compiled.registers.V)), 0);
+		EXPECT_EQ(compiled.registers.I, interpreted.registers.I);
+		EXPECT_EQ(compiled.registers.PC, interpreted.registers.PC);
+	}
+	EXPECT_EQ(compiled.registers.V[0x02], 0x77);
+
+	chip8_destroy(&compiled);
+	chip8_destroy(&interpreted);
+}
+#endif
+
+TEST(Memory, tracks_written_pages) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+	const char program[] = {
+		(char)0xA3, 0x00,	// LD I, 0x300
+		(char)0xF0, 0x55,	// LD [I], V0
+	};
+	chip8_load(&chip8, program, sizeof(program));
+	EXPECT_EQ(chip8.memory.written_pages, 0ULL);
+
+	chip8_run(&chip8, 2);
+	EXPECT_EQ(chip8.memory.written_pages, 1ULL << (0x300 / CHIP8_MEMORY_PAGE_SIZE));
+
+	chip8_load(&chip8, program, sizeof(program));
+	EXPECT_EQ(chip8.memory.written_pages, 0ULL);
+}
+
+TEST(Memory, copies_shared_pages_on_write) {
+	const char program[] = {
+		(char)0xA2, 0x00,	// LD I, 0x200
+		(char)0xF0, 0x55,	// LD [I], V0
+	};
+	chip8_memory_image image;
+	chip8_image_init(&image, program, sizeof(program));
+	chip8 first{};
+	chip8 second{};
+	chip8_init(&first);
+	chip8_init(&second);
+	chip8_load_image(&first, &image);
+	chip8_load_image(&second, &image);
+
+	first.registers.V[0] = 0x12;
+	chip8_run(&first, 2);
+	EXPECT_EQ(chip8_memory_get(&first.memory, 0x200), 0x12);
+	EXPECT_EQ(chip8_memory_get(&first.memory, 0x202), 0xF0);
+	EXPECT_EQ(first.memory.total_private_pages, 1);
+
+	// Neither the image nor the other instance see the write
+	EXPECT_EQ(image.memory[0x200], 0xA2);
+	EXPECT_EQ(chip8_memory_get(&second.memory, 0x200), 0xA2);
+	EXPECT_EQ(second.memory.total_private_pages, 0);
+
+	chip8_destroy(&first);
+	chip8_destroy(&second);
+}
+
+TEST(Memory, shares_decoded_instructions_until_written) {
+	char program[0x42] = {
+		(char)0xA2, 0x40,	// 0x200: LD I, 0x240
+		0x60, 0x42,			// 0x202: LD V0, 0x42
+		(char)0xF0, 0x55,	// 0x204: LD [I], V0 - turns 0x23F into LD V1, 0x42, across the page boundary
+		0x12, 0x3F,			// 0x206: JP 0x23F
+	};
+	program[0x3F] = 0x61;	// 0x23F: LD V1, 0x00
+	chip8_memory_image image;
+	chip8_image_init(&image, program, sizeof(program));
+	chip8 chip8{};
+	chip8_init(&chip8);
+	chip8_load_image(&chip8, &image);
+
+	chip8_run(&chip8, 5);
+	EXPECT_EQ(chip8.registers.V[0x01], 0x42);
+	// nothing was decoded from a page of its own, and other instances still get the image's instruction
+	EXPECT_EQ(chip8.decode_cache.total_private_pages, 0);
+	EXPECT_EQ(image.decoded[0x23F].kk, 0x00);
+
+	chip8_destroy(&chip8);
+}
+
+TEST(Screen, hash_depends_on_pixels) {
+	chip8_screen screen{};
+	const unsigned long long empty = chip8_screen_hash(&screen);
+
+	chip8_screen_set(&screen, 0, 0);
+	const unsigned long long one_pixel = chip8_screen_hash(&screen);
+	EXPECT_NE(empty, one_pixel);
+
+	chip8_screen_clear(&screen);
+	chip8_screen_set(&screen, 63, 31);
+	EXPECT_NE(chip8_screen_hash(&screen), one_pixel);
+
+	chip8_screen_clear(&screen);
+	EXPECT_EQ(chip8_screen_hash(&screen), empty);
+}
+
+TEST(Screen, tracks_the_rows_that_changed) {
+	chip8_screen screen{};
+	const char sprite[] = { (char)0xF0, 0x00, (char)0x90, (char)0xF0 };
+
+	// wraps around the bottom, and the blank second row changes nothing
+	chip8_screen_draw_sprite(&screen, 60, 30, sprite, 4);
+	EXPECT_EQ(chip8_screen_take_dirty_rows(&screen), 1u << 30 | 1u << 0 | 1u << 1);
+	EXPECT_EQ(chip8_screen_take_dirty_rows(&screen), 0u);
+
+	// only the rows that had pixels on are cleared
+	chip8_screen_set(&screen, 5, 12);
+	chip8_screen_take_dirty_rows(&screen);
+	chip8_screen_clear(&screen);
+	EXPECT_EQ(chip8_screen_take_dirty_rows(&screen), 1u << 30 | 1u << 0 | 1u << 1 | 1u << 12);
+	chip8_screen_clear(&screen);
+	EXPECT_EQ(chip8_screen_take_dirty_rows(&screen), 0u);
+}
+
+TEST(FrameBuffer, taken_screen_covers_the_rows_of_the_screens_it_replaced) {
+	chip8_frame_buffer frames;
+	chip8_frame_buffer_init(&frames);
+	chip8_screen screen{};
+
+	// three screens published without a take, each changing one row
+	for (int y = 0; y < 3; y++) {
+		chip8_screen_set(&screen, 0, y);
+		chip8_frame_buffer_publish(&frames, &screen, chip8_screen_take_dirty_rows(&screen));
+	}
+	const chip8_screen* taken = chip8_frame_buffer_take(&frames);
+	ASSERT_NE(taken, nullptr);
+	EXPECT_EQ(taken->dirty_rows & 0x7u, 0x7u);
+	EXPECT_EQ(chip8_frame_buffer_take(&frames), nullptr);
+}
+
+TEST(FrameBuffer, copying_only_dirty_rows_keeps_the_taker_up_to_date) {
+	chip8_frame_buffer frames;
+	chip8_frame_buffer_init(&frames);
+	chip8_random random;
+	chip8_random_seed(&random, 25);
+	chip8_screen screen{};
+	// what a frontend uploading only the dirty rows of every taken screen ends up showing
+	unsigned long long shown[CHIP8_HEIGHT] = {};
+
+	for (int i = 0; i < 10000; i++) {
+		if (chip8_random_byte(&random) & 1) {
+			chip8_screen_set(&screen, chip8_random_byte(&random) % CHIP8_WIDTH, chip8_random_byte(&random) % CHIP8_HEIGHT);
+			chip8_frame_buffer_publish(&frames, &screen, chip8_screen_take_dirty_rows(&screen));
+		}
+		if (chip8_random_byte(&random) % 3 == 0) {
+			const chip8_screen* taken = chip8_frame_buffer_take(&frames);
+			if (taken != nullptr) {
+				for (int y = 0; y < CHIP8_HEIGHT; y++) {
+					if (taken->dirty_rows & (1u << y)) {
+						shown[y] = taken->pixels[y];
+					}
+				}
+				ASSERT_EQ(memcmp(shown, taken->pixels, sizeof(shown)), 0) << "after " << i << " steps";
+			}
+		}
+	}
+}
+
+TEST(Script, parses_and_applies_events) {
+	chip8_script script{};
+	ASSERT_TRUE(chip8_script_parse(&script, "# press 5\n0 down 5\n\n2 up 5\n2 down F\n", nullptr));
+	ASSERT_EQ(script.total_events, 3u);
+
+	chip8_keyboard keyboard{};
+	chip8_script_apply(&script, &keyboard, 0);
+	EXPECT_TRUE(chip8_keyboard_is_down(&keyboard, 0x05));
+
+	chip8_script_apply(&script, &keyboard, 1);
+	EXPECT_TRUE(chip8_keyboard_is_down(&keyboard, 0x05));
+
+	chip8_script_apply(&script, &keyboard, 2);
+	EXPECT_FALSE(chip8_keyboard_is_down(&keyboard, 0x05));
+	EXPECT_TRUE(chip8_keyboard_is_down(&keyboard, 0x0F));
+
+	chip8_script_free(&script);
+}
+
+TEST(Script, rejects_invalid_lines) {
+	chip8_script script{};
+	int error_line = 0;
+	EXPECT_FALSE(chip8_script_parse(&script, "0 down 5\n1 press 5\n", &error_line));
+	EXPECT_EQ(error_line, 2);
+	EXPECT_FALSE(chip8_script_parse(&script, "0 down 10\n", &error_line));
+	EXPECT_FALSE(chip8_script_parse(&script, "5 down 1\n3 up 1\n", &error_line));
+	EXPECT_EQ(error_line, 2);
+}
+
+struct platform_counter
+{
+	chip8_mutex* mutex;
+	int value;
+};
+
+static void increment_counter(void* argument)
+{
+	platform_counter* counter = (platform_counter*)argument;
+	for (int i = 0; i < 10000; i++)
+	{
+		chip8_platform_mutex_lock(counter->mutex);
+		counter->value++;
+		chip8_platform_mutex_unlock(counter->mutex);
+	}
+}
+
+TEST(Platform, threads_share_a_mutex) {
+	platform_counter counter{ chip8_platform_mutex_create(), 0 };
+	ASSERT_NE(counter.mutex, nullptr);
+
+	chip8_thread* threads[4];
+	for (chip8_thread*& thread : threads)
+	{
+		thread = chip8_platform_thread_create(increment_counter, &counter);
+		ASSERT_NE(thread, nullptr);
+	}
+	for (chip8_thread* thread : threads)
+	{
+		chip8_platform_thread_join(thread);
+	}
+
+	EXPECT_EQ(counter.value, 40000);
+	chip8_platform_mutex_destroy(counter.mutex);
+}
+
+TEST(Platform, clock_is_monotonic) {
+	const unsigned long long start = chip8_platform_time_ns();
+	chip8_platform_sleep_ns(1000000);
+	EXPECT_GE(chip8_platform_time_ns() - start, 1000000ULL);
+}
+
+static const char lockstep_test_program[] = {
+	(char)0xC0, 0x03,	// 0x200: RND V0, 0x03
+	0x30, 0x01,			// 0x202: SE V0, 0x01 - lanes diverge here
+	0x12, 0x0A,			// 0x204: JP 0x20A
+	0x71, 0x05,			// 0x206: ADD V1, 0x05
+	(char)0x81, 0x0E,	// 0x208: SHL V1
+	(char)0x82, 0x14,	// 0x20A: ADD V2, V1
+	(char)0x84, 0x25,	// 0x20C: SUB V4, V2
+	(char)0x8F, 0x0E,	// 0x20E: SHL VF
+	(char)0xA0, 0x00,	// 0x210: LD I, 0x000
+	(char)0xD2, 0x15,	// 0x212: DRW V2, V1, 5
+	0x73, 0x01,			// 0x214: ADD V3, 0x01
+	0x12, 0x00,			// 0x216: JP 0x200
+};
+
+static void run_lockstep_against_instances(const bool use_avx2)
+{
+	const int lanes = 37;
+	chip8_lockstep* lockstep = chip8_lockstep_create(lanes);
+	ASSERT_NE(lockstep, nullptr);
+	if (use_avx2 && !lockstep->use_avx2)
+	{
+		chip8_lockstep_destroy(lockstep);
+		GTEST_SKIP() << "AVX2 not supported on this host";
+	}
+	lockstep->use_avx2 = use_avx2;
+	chip8_lockstep_load(lockstep, lockstep_test_program, sizeof(lockstep_test_program));
+	std::vector<chip8> instances(lanes);
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		chip8_lockstep_seed(lockstep, lane, lane);
+		chip8_init(&instances[lane]);
+		chip8_seed(&instances[lane], lane);
+		chip8_load(&instances[lane], lockstep_test_program, sizeof(lockstep_test_program));
+	}
+
+	for (int frame = 0; frame < 60; frame++)
+	{
+		chip8_lockstep_run(lockstep, 9);
+		chip8_lockstep_tick_timers(lockstep);
+		for (int lane = 0; lane < lanes; lane++)
+		{
+			chip8_run(&instances[lane], 9);
+			chip8_tick_timers(&instances[lane]);
+
+			const chip8* machine = chip8_lockstep_lane(lockstep, lane);
+			ASSERT_EQ(memcmp(&machine->registers, &instances[lane].registers, sizeof(machine->registers)), 0) << "frame " << frame << " lane " << lane;
+			ASSERT_EQ(memcmp(&machine->screen, &instances[lane].screen, sizeof(machine->screen)), 0) << "frame " << frame << " lane " << lane;
+		}
+	}
+
+	EXPECT_GT(lockstep->lockstep_steps, 0ULL);
+	EXPECT_GT(lockstep->divergent_steps, 0ULL);
+	chip8_lockstep_destroy(lockstep);
+}
+
+TEST(Lockstep, lanes_match_independent_instances) {
+	run_lockstep_against_instances(false);
+}
+
+TEST(Lockstep, avx2_lanes_match_independent_instances) {
+	run_lockstep_against_instances(true);
+}
+
+static const char state_test_program[] = {
+	(char)0xA3, 0x00,	// 0x200: LD I, 0x300
+	(char)0xC0, (char)0xFF,	// 0x202: RND V0, 0xFF
+	(char)0xF0, 0x33,	// 0x204: LD B, V0
+	(char)0xF2, 0x65,	// 0x206: LD V2, [I]
+	(char)0xF2, 0x29,	// 0x208: LD F, V2
+	(char)0xD0, 0x15,	// 0x20A: DRW V0, V1, 5
+	0x71, 0x03,			// 0x20C: ADD V1, 0x03
+	(char)0xF1, 0x15,	// 0x20E: LD DT, V1
+	0x12, 0x00,			// 0x210: JP 0x200
+};
+
+TEST(State, restores_a_running_program) {
+	chip8 original{};
+	chip8_init(&original);
+	chip8_load(&original, state_test_program, sizeof(state_test_program));
+	chip8_keyboard_down(&original.keyboard, 0x7);
+	chip8_run(&original, 100);
+	chip8_tick_timers(&original);
+
+	alignas(8) unsigned char buf[CHIP8_STATE_MAX_SIZE];
+	const size_t size = chip8_save_state(&original, buf);
+	// the only written page is the one holding the BCD digits
+	EXPECT_EQ(size, sizeof(chip8_state) + CHIP8_MEMORY_PAGE_SIZE);
+	EXPECT_EQ(size % 8, 0u);
+
+	chip8 restored{};
+	chip8_init(&restored);
+	chip8_load(&restored, state_test_program, sizeof(state_test_program));
+	ASSERT_TRUE(chip8_load_state(&restored, buf, size));
+	EXPECT_TRUE(chip8_keyboard_is_down(&restored.keyboard, 0x7));
+
+	chip8_run(&original, 100);
+	chip8_run(&restored, 100);
+	EXPECT_EQ(memcmp(&original.registers, &restored.registers, sizeof(original.registers)), 0);
+	EXPECT_EQ(memcmp(original.screen.pixels, restored.screen.pixels, sizeof(original.screen.pixels)), 0);
+	for (int i = 0x300; i < 0x303; i++)
+	{
+		EXPECT_EQ(chip8_memory_get(&original.memory, i), chip8_memory_get(&restored.memory, i));
+	}
+
+	chip8_destroy(&original);
+	chip8_destroy(&restored);
+}
+
+TEST(State, rejects_states_of_other_programs) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+	chip8_load(&chip8, state_test_program, sizeof(state_test_program));
+	alignas(8) unsigned char buf[CHIP8_STATE_MAX_SIZE];
+	const size_t size = chip8_save_state(&chip8, buf);
+
+	EXPECT_FALSE(chip8_load_state(&chip8, buf, size - 1));
+	chip8_load(&chip8, block_test_program, sizeof(block_test_program));
+	EXPECT_FALSE(chip8_load_state(&chip8, buf, size));
+	EXPECT_EQ(chip8.registers.PC, CHIP8_PROGRAM_LOAD_ADDRESS);
+
+	chip8_destroy(&chip8);
+}
+
+TEST(Rewind, steps_back_through_recorded_frames) {
+	chip8_rewind* rewind = chip8_rewind_create(24 * 1024, 8);
+	ASSERT_NE(rewind, nullptr);
+	chip8 chip8{};
+	chip8_init(&chip8);
+	chip8_load(&chip8, state_test_program, sizeof(state_test_program));
+
+	const int frames = 2000;
+	std::vector<std::vector<unsigned char>> states;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		alignas(8) unsigned char buf[CHIP8_STATE_MAX_SIZE];
+		states.emplace_back(buf, buf + chip8_save_state(&chip8, buf));
+		chip8_rewind_push(rewind, &chip8);
+		chip8_run(&chip8, 9);
+		chip8_tick_timers(&chip8);
+	}
+
+	// The budget doesn't hold every frame, the most recent ones come back in reverse order
+	int restored = 0;
+	while (chip8_rewind_step_back(rewind, &chip8))
+	{
+		restored++;
+		alignas(8) unsigned char buf[CHIP8_STATE_MAX_SIZE];
+		const std::vector<unsigned char> state(buf, buf + chip8_save_state(&chip8, buf));
+		ASSERT_EQ(state, states[frames - restored]) << "frame " << frames - restored;
+	}
+	EXPECT_GT(restored, 8);
+	EXPECT_LT(restored, frames);
+
+	chip8_rewind_destroy(rewind);
+	chip8_destroy(&chip8);
+}
+
+TEST(Scheduler, matches_instances_run_on_their_own) {
+	const char busy[] = {
+		0x70, 0x01,			// 0x200: ADD V0, 0x01
+		0x12, 0x00,			// 0x202: JP 0x200
+	};
+	const char sleeper[] = {
+		0x61, 0x05,			// 0x200: LD V1, 0x05
+		(char)0xF1, 0x15,	// 0x202: LD DT, V1
+		(char)0xF0, 0x07,	// 0x204: LD V0, DT
+		0x30, 0x00,			// 0x206: SE V0, 0x00
+		0x12, 0x04,			// 0x208: JP 0x204
+		0x72, 0x01,			// 0x20A: ADD V2, 0x01
+		0x12, 0x00,			// 0x20C: JP 0x200
+	};
+	const char typist[] = {
+		(char)0xF3, 0x0A,	// 0x200: LD V3, K
+		(char)0x84, 0x34,	// 0x202: ADD V4, V3
+		0x12, 0x00,			// 0x204: JP 0x200
+	};
+	const struct { const char* program; size_t size; int instructions_per_tick; } programs[] = {
+		{ busy, sizeof(busy), 25 }, { sleeper, sizeof(sleeper), 10 }, { typist, sizeof(typist), 10 },
+	};
+	const int total = sizeof(programs) / sizeof(programs[0]);
+
+	chip8 scheduled[total] = {};
+	chip8 alone[total] = {};
+	chip8_scheduler* scheduler = chip8_scheduler_create(8);
+	ASSERT_NE(scheduler, nullptr);
+	for (int i = 0; i < total; i++)
+	{
+		for (chip8* chip8 : { &scheduled[i], &alone[i] })
+		{
+			chip8_init(chip8);
+			chip8_load(chip8, programs[i].program, programs[i].size);
+			chip8_set_instructions_per_tick(chip8, programs[i].instructions_per_tick);
+		}
+		ASSERT_EQ(chip8_scheduler_add(scheduler, &scheduled[i]), i);
+	}
+
+	int fewest_runnable = total;
+	for (int tick = 0; tick < 200; tick++)
+	{
+		if (tick % 37 == 20)
+		{
+			chip8_scheduler_key_down(scheduler, 2, tick % 16);
+			chip8_keyboard_down(&alone[2].keyboard, tick % 16);
+		}
+		if (tick % 37 == 25)
+		{
+			chip8_scheduler_key_up(scheduler, 2, (tick - 5) % 16);
+			chip8_keyboard_up(&alone[2].keyboard, (tick - 5) % 16);
+		}
+
+		chip8_scheduler_tick(scheduler);
+		for (int i = 0; i < total; i++)
+		{
+			chip8_advance(&alone[i], programs[i].instructions_per_tick);
+		}
+		fewest_runnable = scheduler->total_runnable < fewest_runnable ? scheduler->total_runnable : fewest_runnable;
+	}
+
+	// only the busy instance keeps running, the others spend most of their time parked
+	EXPECT_EQ(fewest_runnable, 1);
+	for (int i = 0; i < total; i++)
+	{
+		const chip8* synced = chip8_scheduler_sync(scheduler, i);
+		EXPECT_EQ(memcmp(&synced->registers, &alone[i].registers, sizeof(alone[i].registers)), 0) << "instance " << i;
+		EXPECT_EQ(synced->clock.instructions, alone[i].clock.instructions) << "instance " << i;
+	}
+	EXPECT_GT(alone[1].registers.V[2], 10);
+	EXPECT_NE(alone[2].registers.V[4], 0);
+
+	chip8_scheduler_destroy(scheduler);
+	for (int i = 0; i < total; i++)
+	{
+		chip8_destroy(&scheduled[i]);
+		chip8_destroy(&alone[i]);
+	}
+}
+
+TEST(InputLog, replays_a_recorded_session) {
+	const char program[] = {
+		0x60, 0x05,			// 0x200: LD V0, 0x05
+		(char)0xE0, (char)0xA1,	// 0x202: SKNP V0
+		0x71, 0x01,			// 0x204: ADD V1, 0x01
+		0x72, 0x01,			// 0x206: ADD V2, 0x01
+		0x12, 0x02,			// 0x208: JP 0x202
+	};
+	const int instructions_per_frame = 10;
+	// frame, instruction within the frame, key down
+	const struct { unsigned long long frame; int instruction; bool down; } events[] = {
+		{ 3, 0, true }, { 3, 7, false }, { 20, 4, true }, { 41, 9, false },
+	};
+
+	chip8 live{};
+	chip8_init(&live);
+	chip8_seed(&live, 42);
+	chip8_load(&live, program, sizeof(program));
+	chip8_input_recorder recorder;
+	ASSERT_TRUE(chip8_input_recorder_start(&recorder, &live, 42, instructions_per_frame));
+	size_t next = 0;
+	for (unsigned long long frame = 0; frame < 50; frame++)
+	{
+		int executed = 0;
+		for (; next < sizeof(events) / sizeof(events[0]) && events[next].frame == frame; next++)
+		{
+			chip8_run(&live, events[next].instruction - executed);
+			executed = events[next].instruction;
+			if (events[next].down)
+			{
+				chip8_keyboard_down(&live.keyboard, 0x5);
+			}
+			else
+			{
+				chip8_keyboard_up(&live.keyboard, 0x5);
+			}
+			ASSERT_TRUE(chip8_input_record(&recorder, frame, executed, 0x5, events[next].down));
+		}
+		chip8_run(&live, instructions_per_frame - executed);
+		chip8_tick_timers(&live);
+	}
+	ASSERT_TRUE(chip8_input_recorder_finish(&recorder, 50));
+	EXPECT_EQ(recorder.size, (size_t)CHIP8_INPUT_LOG_HEADER_SIZE + 5 * 3);
+
+	chip8_input_replay replay;
+	ASSERT_TRUE(chip8_input_replay_open(&replay, recorder.data, recorder.size));
+	EXPECT_EQ(replay.seed, 42u);
+	EXPECT_EQ(replay.instructions_per_frame, instructions_per_frame);
+	EXPECT_EQ(replay.frames, 50u);
+
+	chip8 replayed{};
+	chip8_init(&replayed);
+	chip8_seed(&replayed, replay.seed);
+	chip8_load(&replayed, program, sizeof(program));
+	EXPECT_EQ(replay.image_hash, replayed.memory.image->hash);
+	for (unsigned long long frame = 0; frame < replay.frames; frame++)
+	{
+		chip8_input_replay_run_frame(&replay, &replayed, frame);
+		chip8_tick_timers(&replayed);
+	}
+	EXPECT_NE(live.registers.V[1], 0);
+	EXPECT_EQ(memcmp(&live.registers, &replayed.registers, sizeof(live.registers)), 0);
+	EXPECT_EQ(memcmp(live.keyboard.keyboard, replayed.keyboard.keyboard, sizeof(live.keyboard.keyboard)), 0);
+
+	chip8_input_recorder_free(&recorder);
+	chip8_destroy(&live);
+	chip8_destroy(&replayed);
+}
+
+TEST(InputLog, rejects_instructions_per_frame_the_header_cannot_hold) {
+	chip8 chip8{};
+	chip8_init(&chip8);
+	const char program[] = { 0x12, 0x00 };
+	chip8_load(&chip8, program, sizeof(program));
+	chip8_input_recorder recorder;
+
+	ASSERT_TRUE(chip8_input_recorder_start(&recorder, &chip8, 1, CHIP8_INPUT_LOG_MAX_INSTRUCTIONS_PER_FRAME));
+	chip8_input_replay replay;
+	ASSERT_TRUE(chip8_input_replay_open(&replay, recorder.data, recorder.size));
+	EXPECT_EQ(replay.instructions_per_frame, CHIP8_INPUT_LOG_MAX_INSTRUCTIONS_PER_FRAME);
+	chip8_input_recorder_free(&recorder);
+
+	EXPECT_FALSE(chip8_input_recorder_start(&recorder, &chip8, 1, CHIP8_INPUT_LOG_MAX_INSTRUCTIONS_PER_FRAME + 1));
+	chip8_input_recorder_free(&recorder);
+	EXPECT_FALSE(chip8_input_recorder_start(&recorder, &chip8, 1, 0));
+	chip8_input_recorder_free(&recorder);
+
+	chip8_destroy(&chip8);
+}
@@ -3,11 +3,8 @@
 #include <memory.h>
 #include "chip8.h"
 #include <assert.h>
-#include <SDL.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
-#include <Windows.h>
 
 /*
 	The original implementation of the Chip-8 language includes 36 different instructions,
@@ -34,482 +31,947 @@
 
 
  // http://devernay.free.fr/hacks/chip8/C8TECH10.HTM#font
-const char chip8_default_character_set[] = {
-	0xF0,0x90,0x90,0x90,0xF0,	// 0
-	0x20,0x60,0x20,0x20,0x70,	// 1
-	0xF0,0x10,0xF0,0x80,0xF0,	// 2
-	0xF0,0x10,0xF0,0x10,0xF0,	// 3
-	0x90,0x90,0xF0,0x10,0x10,	// 4
-	0xF0,0x80,0xF0,0x10,0xF0,	// 5
-	0xF0,0x80,0xF0,0x90,0xF0,	// 6
-	0xF0,0x10,0x20,0x40,0x40,	// 7
-	0xF0,0x90,0xF0,0x90,0xF0,	// 8
-	0xF0,0x90,0xF0,0x10,0xF0,	// 9
-	0xF0,0x90,0xF0,0x90,0x90,	// A
-	0xE0,0x90,0xE0,0x90,0xE0,	// B
-	0xF0,0x80,0x80,0x80,0xF0,	// C
-	0xE0,0x90,0x90,0x90,0xE0,	// D
-	0xF0,0x80,0xF0,0x80,0xF0,	// E
-	0xF0,0x80,0xF0,0x80,0x80	// F
-};
+#define CHIP8_DEFAULT_CHARACTER_SET \
+	0xF0,0x90,0x90,0x90,0xF0,	/* 0 */ \
+	0x20,0x60,0x20,0x20,0x70,	/* 1 */ \
+	0xF0,0x10,0xF0,0x80,0xF0,	/* 2 */ \
+	0xF0,0x10,0xF0,0x10,0xF0,	/* 3 */ \
+	0x90,0x90,0xF0,0x10,0x10,	/* 4 */ \
+	0xF0,0x80,0xF0,0x10,0xF0,	/* 5 */ \
+	0xF0,0x80,0xF0,0x90,0xF0,	/* 6 */ \
+	0xF0,0x10,0x20,0x40,0x40,	/* 7 */ \
+	0xF0,0x90,0xF0,0x90,0xF0,	/* 8 */ \
+	0xF0,0x90,0xF0,0x10,0xF0,	/* 9 */ \
+	0xF0,0x90,0xF0,0x90,0x90,	/* A */ \
+	0xE0,0x90,0xE0,0x90,0xE0,	/* B */ \
+	0xF0,0x80,0x80,0x80,0xF0,	/* C */ \
+	0xE0,0x90,0x90,0x90,0xE0,	/* D */ \
+	0xF0,0x80,0xF0,0x80,0xF0,	/* E */ \
+	0xF0,0x80,0xF0,0x80,0x80	/* F */
+
+const char chip8_default_character_set[] = { CHIP8_DEFAULT_CHARACTER_SET };
+
+// Memory before a program is loaded, shared by every instance
+static const struct chip8_memory_image chip8_empty_image = { { CHIP8_DEFAULT_CHARACTER_SET }, 0, { { 0 } } };
 
 void chip8_init(struct chip8* chip8)
 {
 	memset(chip8, 0, sizeof(struct chip8));
-	memcpy(&chip8->memory.memory, chip8_default_character_set, sizeof(chip8_default_character_set));
+	chip8_memory_map(&chip8->memory, &chip8_empty_image);
+	chip8_random_seed(&chip8->random, CHIP8_DEFAULT_RANDOM_SEED);
+	chip8_set_instructions_per_tick(chip8, CHIP8_INSTRUCTIONS_PER_FRAME);
+}
+
+void chip8_destroy(struct chip8* chip8)
+{
+	chip8_jit_destroy(chip8->jit);
+	chip8->jit = NULL;
+	free(chip8->block_cache);
+	chip8->block_cache = NULL;
+	chip8_decode_cache_free(&chip8->decode_cache);
+	chip8_memory_free(&chip8->memory);
+	free(chip8->image);
+	chip8->image = NULL;
+}
+
+void chip8_seed(struct chip8* chip8, const unsigned long long seed)
+{
+	chip8_random_seed(&chip8->random, seed);
 }
 
-static char chip8_wait_for_key_press(const struct chip8* chip8)
+bool chip8_set_engine(struct chip8* chip8, const enum chip8_engine engine)
 {
-	printf("%s\n", "Waiting for a key to be pressed");
-	SDL_Event event;
-	while (SDL_WaitEvent(&event))
+	if (engine == CHIP8_ENGINE_JIT && chip8->jit == NULL)
 	{
-		if (event.type != SDL_KEYDOWN)
+		chip8->jit = chip8_jit_create();
+		if (chip8->jit == NULL)
 		{
-			continue;
+			return false;
+		}
+	}
+	if (engine == CHIP8_ENGINE_BLOCKS && chip8->block_cache == NULL)
+	{
+		chip8->block_cache = calloc(1, sizeof(struct chip8_block_cache));
+		if (chip8->block_cache == NULL)
+		{
+			return false;
 		}
+	}
 
-		const char c = event.key.keysym.sym;
-		const char chip8_key = chip8_keyboard_map(&chip8->keyboard, c);
+	// the other engines' caches are only dropped once the new engine is sure to be available
+	if (engine != CHIP8_ENGINE_JIT)
+	{
+		chip8_jit_destroy(chip8->jit);
+		chip8->jit = NULL;
+	}
+	if (engine != CHIP8_ENGINE_BLOCKS)
+	{
+		free(chip8->block_cache);
+		chip8->block_cache = NULL;
+	}
 
-		printf("The key %c has been pressed\n", chip8_key);
+	chip8->engine = engine;
+	return true;
+}
 
-		if (chip8_key != -1)
-		{
-			return chip8_key;
-		}
+// Every write the program makes to memory has to go through here so stale decoded instructions and blocks are dropped
+static void chip8_store(struct chip8* chip8, const int index, const unsigned char val)
+{
+	chip8_memory_set(&chip8->memory, index, val);
+	chip8_decode_cache_invalidate(&chip8->decode_cache, &chip8->memory, index);
+	if (chip8->block_cache != NULL)
+	{
+		chip8_block_cache_invalidate(chip8->block_cache, index);
+	}
+	if (chip8->jit != NULL)
+	{
+		chip8_jit_invalidate(chip8->jit, index);
 	}
+}
+
+/*
+	One handler per operation. The handlers are shared by all the dispatch strategies
+	(see CHIP8_DISPATCH in config.h), so the behavior is the same whichever one is built.
+ */
+
+static void chip8_op_unknown(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	(void)chip8;
+	(void)instruction;
+	fputs("opcode not supported\n", stderr);
+}
+
+// 00E0 - CLS
+// Clear the display.
+static void chip8_op_cls(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	(void)instruction;
+	chip8_screen_clear(&chip8->screen);
+}
 
-	return  -1;
+// 00EE - RET
+// Return from a subroutine.
+// The interpreter sets the program counter to the address at the top of the stack, then subtracts 1 from the stack pointer.
+static void chip8_op_ret(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	(void)instruction;
+	chip8->registers.PC = chip8_stack_pop(chip8);
 }
 
-static void chip8_exec_extended(struct chip8* chip8, const unsigned short opcode)
+// 1nnn - JP addr
+// Jump to location nnn.
+// The interpreter sets the program counter to nnn.
+static void chip8_op_jp_addr(struct chip8* chip8, const struct chip8_instruction* instruction)
 {
-	const unsigned short nnn = opcode & 0x0FFF;
-	const unsigned short kk = opcode & 0x00FF;
-	const unsigned short n = opcode & 0x000F;
-	const unsigned short x = (opcode >> 8) & 0x000F;
-	const unsigned short y = (opcode >> 4) & 0x000F;
+	chip8->registers.PC = instruction->nnn;
+}
 
-	// the first 4 bits represent the opcode
-	switch (opcode & 0xF000)
+// 2nnn - CALL addr
+// Call subroutine at nnn.
+// The interpreter increments the stack pointer, then puts the current PC on the top of the stack.The PC is then set to nnn.
+static void chip8_op_call_addr(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8_stack_push(chip8, chip8->registers.PC);
+	chip8->registers.PC = instruction->nnn;
+}
+
+// 3xkk - SE Vx, byte
+// Skip next instruction if Vx = kk.
+// The interpreter compares register Vx to kk, and if they are equal, increments the program counter by 2.
+static void chip8_op_se_vx_byte(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	if (chip8->registers.V[instruction->x] == instruction->kk)
 	{
-		// 1nnn - JP addr
-		// Jump to location nnn.
-		// The interpreter sets the program counter to nnn.
-		case 0x1000:
-			chip8->registers.PC = nnn;
-			break;
+		chip8->registers.PC += 2;
+	}
+}
 
-			// 2nnn - CALL addr
-			// Call subroutine at nnn.
-			// The interpreter increments the stack pointer, then puts the current PC on the top of the stack.The PC is then set to nnn.
-		case 0x2000:
-			chip8_stack_push(chip8, chip8->registers.PC);
-			chip8->registers.PC = nnn;
-			break;
+// 4xkk - SNE Vx, byte
+// Skip next instruction if Vx != kk.
+// The interpreter compares register Vx to kk, and if they are not equal, increments the program counter by 2.
+static void chip8_op_sne_vx_byte(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	if (chip8->registers.V[instruction->x] != instruction->kk)
+	{
+		chip8->registers.PC += 2;
+	}
+}
 
-			// 3xkk - SE Vx, byte
-			// Skip next instruction if Vx = kk.
-			// The interpreter compares register Vx to kk, and if they are equal, increments the program counter by 2.
-		case 0x3000:
-			if (chip8->registers.V[x] == kk)
-			{
-				chip8->registers.PC += 2;
-			}
-			break;
+// 5xy0 - SE Vx, Vy
+// Skip next instruction if Vx = Vy.
+// The interpreter compares register Vx to register Vy, and if they are equal, increments the program counter by 2.
+static void chip8_op_se_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	if (chip8->registers.V[instruction->x] == chip8->registers.V[instruction->y])
+	{
+		chip8->registers.PC += 2;
+	}
+}
 
-			// 4xkk - SNE Vx, byte
-			// Skip next instruction if Vx != kk.
-			// The interpreter compares register Vx to kk, and if they are not equal, increments the program counter by 2.
-		case 0x4000:
-			if (chip8->registers.V[x] != kk)
-			{
-				chip8->registers.PC += 2;
-			}
-			break;
+// 6xkk - LD Vx, byte
+// Set Vx = kk.
+// The interpreter puts the value kk into register Vx.
+static void chip8_op_ld_vx_byte(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] = instruction->kk;
+}
 
-			// 5xy0 - SE Vx, Vy
-			// Skip next instruction if Vx = Vy.
-			// The interpreter compares register Vx to register Vy, and if they are equal, increments the program counter by 2.
-		case 0x5000:
-			if (chip8->registers.V[x] == chip8->registers.V[y])
-			{
-				chip8->registers.PC += 2;
-			}
-			break;
+// 7xkk - ADD Vx, byte
+// Set Vx = Vx + kk.
+// Adds the value kk to the value of register Vx, then stores the result in Vx.
+static void chip8_op_add_vx_byte(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] += instruction->kk;
+}
 
-			// 6xkk - LD Vx, byte
-			// Set Vx = kk.
-			// The interpreter puts the value kk into register Vx.
-		case 0x6000:
-			chip8->registers.V[x] = kk;
-			break;
+// 8xy0 - LD Vx, Vy
+// Set Vx = Vy.
+// Stores the value of register Vy in register Vx.
+static void chip8_op_ld_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] = chip8->registers.V[instruction->y];
+}
 
-			// 7xkk - ADD Vx, byte
-			// Set Vx = Vx + kk.
-			// Adds the value kk to the value of register Vx, then stores the result in Vx.
-		case 0x7000:
-			chip8->registers.V[x] += kk;
-			break;
+// 8xy1 - OR Vx, Vy
+// Set Vx = Vx OR Vy.
+// Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx.
+static void chip8_op_or_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] |= chip8->registers.V[instruction->y];
+}
 
-		case 0x8000:
+/*
+ * 8xy2 - AND Vx, Vy
+ * Set Vx = Vx AND Vy.
+ * Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
+ */
+static void chip8_op_and_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] &= chip8->registers.V[instruction->y];
+}
 
-			switch (opcode & 0x000f)
-			{
-				// 8xy0 - LD Vx, Vy
-				// Set Vx = Vy.
-				// Stores the value of register Vy in register Vx.
-				case 0x0000:
-					chip8->registers.V[x] = chip8->registers.V[y];
-					break;
-
-					// 8xy1 - OR Vx, Vy
-					// Set Vx = Vx OR Vy.
-					// Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx.
-				case 0x0001:
-					chip8->registers.V[x] |= chip8->registers.V[y];
-					break;
-					/*
-					 * 8xy2 - AND Vx, Vy
-					 * Set Vx = Vx AND Vy.
-					 * Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
-					 */
-				case 0x0002:
-					chip8->registers.V[x] &= chip8->registers.V[y];
-					break;
-
-					/*
-					 * 8xy3 - XOR Vx, Vy
-					 * Set Vx = Vx XOR Vy.
-					 */
-				case 0x0003:
-					chip8->registers.V[x] ^= chip8->registers.V[y];
-					break;
-
-					/*
-					 * 8xy4 - ADD Vx, Vy
-					 * Set Vx = Vx + Vy, set VF = carry.
-					 * The values of Vx and Vy are added together. If the result is greater than
-					 * 8 bits (i.e., > 255,) VF is set to 1, otherwise 0. Only the lowest 8 bits
-					 * of the result are kept, and stored in Vx.
-					 */
-				case 0x0004:
-					const unsigned short sum = chip8->registers.V[x] + chip8->registers.V[y];
-					chip8->registers.V[x] = sum;
-					if (sum > 255)
-					{
-						chip8->registers.V[0x0F] = 1;
-					}
-					else
-					{
-						chip8->registers.V[0x0F] = 0;
-					}
-					break;
-
-					/*
-					 * 8xy5 - SUB Vx, Vy
-					 * Set Vx = Vx - Vy, set VF = NOT borrow.
-					 * If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx,
-					 * and the results stored in Vx.
-					 */
-				case 0x0005:
-					if (chip8->registers.V[x] > chip8->registers.V[y])
-					{
-						chip8->registers.V[0x0F] = 1;
-					}
-					else
-					{
-						chip8->registers.V[0x0F] = 0;
-					}
-					chip8->registers.V[x] -= chip8->registers.V[y];
-					break;
-
-					/*
-					 * 8xy6 - SHR Vx {, Vy}
-					 * Set Vx = Vx SHR 1.
-					 * If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
-					 */
-				case 0x0006:
-					if ((chip8->registers.V[x] & 0b00000001) == 1)
-					{
-						chip8->registers.V[0x0F] = 1;
-					}
-					else
-					{
-						chip8->registers.V[0x0F] = 0;
-					}
-					chip8->registers.V[x] /= 2;
-					break;
-
-					/*
-					 * 8xy7 - SUBN Vx, Vy
-					 * Set Vx = Vy - Vx, set VF = NOT borrow.
-					 * If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
-					 */
-				case 0x0007:
-					if (chip8->registers.V[x] < chip8->registers.V[y])
-					{
-						chip8->registers.V[0x0F] = 1;
-					}
-					else
-					{
-						chip8->registers.V[0x0F] = 0;
-					}
-					chip8->registers.V[x] = chip8->registers.V[y] - chip8->registers.V[x];
-					break;
-
-					/*
-					 * 8xyE - SHL Vx {, Vy}
-					 * Set Vx = Vx SHL 1.
-					 * If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
-					 */
-				case 0x000E:
-					chip8->registers.V[0x0F] = 0;
-					if (chip8->registers.V[x] & 0b10000000)
-					{
-						chip8->registers.V[0x0F] = 1;
-					}
-					chip8->registers.V[x] *= 2;
-					break;
-				default:
-					puts("opcode not supported");
-			}
+/*
+ * 8xy3 - XOR Vx, Vy
+ * Set Vx = Vx XOR Vy.
+ */
+static void chip8_op_xor_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] ^= chip8->registers.V[instruction->y];
+}
 
-			break;
+/*
+ * 8xy4 - ADD Vx, Vy
+ * Set Vx = Vx + Vy, set VF = carry.
+ * The values of Vx and Vy are added together. If the result is greater than
+ * 8 bits (i.e., > 255,) VF is set to 1, otherwise 0. Only the lowest 8 bits
+ * of the result are kept, and stored in Vx.
+ */
+static void chip8_op_add_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	const unsigned short sum = chip8->registers.V[instruction->x] + chip8->registers.V[instruction->y];
+	chip8->registers.V[instruction->x] = sum;
+	if (sum > 255)
+	{
+		chip8->registers.V[0x0F] = 1;
+	}
+	else
+	{
+		chip8->registers.V[0x0F] = 0;
+	}
+}
 
-			/*
-			 * 9xy0 - SNE Vx, Vy
-			 * Skip next instruction if Vx != Vy.
-			 * The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
-			 */
-		case 0x9000:
-			if (chip8->registers.V[x] != chip8->registers.V[y])
-			{
-				chip8->registers.PC += 2;
-			}
-			break;
+/*
+ * 8xy5 - SUB Vx, Vy
+ * Set Vx = Vx - Vy, set VF = NOT borrow.
+ * If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx,
+ * and the results stored in Vx.
+ */
+static void chip8_op_sub_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	if (chip8->registers.V[instruction->x] > chip8->registers.V[instruction->y])
+	{
+		chip8->registers.V[0x0F] = 1;
+	}
+	else
+	{
+		chip8->registers.V[0x0F] = 0;
+	}
+	chip8->registers.V[instruction->x] -= chip8->registers.V[instruction->y];
+}
 
-			/*
-			 * Annn - LD I, addr
-			 * Set I = nnn.
-			 * The value of register I is set to nnn.
-			 */
-		case 0xA000:
-			chip8->registers.I = nnn;
-			break;
+/*
+ * 8xy6 - SHR Vx {, Vy}
+ * Set Vx = Vx SHR 1.
+ * If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
+ */
+static void chip8_op_shr_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	if ((chip8->registers.V[instruction->x] & 0b00000001) == 1)
+	{
+		chip8->registers.V[0x0F] = 1;
+	}
+	else
+	{
+		chip8->registers.V[0x0F] = 0;
+	}
+	chip8->registers.V[instruction->x] /= 2;
+}
 
-			/*
-			 * Bnnn - JP V0, addr
-			 * Jump to location nnn + V0.
-			 * The program counter is set to nnn plus the value of V0.
-			 */
-		case 0xB000:
-			chip8->registers.PC = nnn + chip8->registers.V[0x00];
-			break;
+/*
+ * 8xy7 - SUBN Vx, Vy
+ * Set Vx = Vy - Vx, set VF = NOT borrow.
+ * If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
+ */
+static void chip8_op_subn_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	if (chip8->registers.V[instruction->x] < chip8->registers.V[instruction->y])
+	{
+		chip8->registers.V[0x0F] = 1;
+	}
+	else
+	{
+		chip8->registers.V[0x0F] = 0;
+	}
+	chip8->registers.V[instruction->x] = chip8->registers.V[instruction->y] - chip8->registers.V[instruction->x];
+}
 
-			/*
-			 * Cxkk - RND Vx, byte
-			 * Set Vx = random byte AND kk.
-			 */
-		case 0xC000:
-			srand(clock());
-			chip8->registers.V[x] = (rand() % 255) & kk;
-			break;
+/*
+ * 8xyE - SHL Vx {, Vy}
+ * Set Vx = Vx SHL 1.
+ * If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
+ */
+static void chip8_op_shl_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[0x0F] = 0;
+	if (chip8->registers.V[instruction->x] & 0b10000000)
+	{
+		chip8->registers.V[0x0F] = 1;
+	}
+	chip8->registers.V[instruction->x] *= 2;
+}
 
-			/*
-			 * Dxyn - DRW Vx, Vy, nibble
-			 * Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
-			 * The interpreter reads n bytes from memory, starting at the address stored in I.
-			 * These bytes are then displayed as sprites on screen at coordinates (Vx, Vy).
-			 * Sprites are XORed onto the existing screen. If this causes any pixels to be erased,
-			 * VF is set to 1, otherwise it is set to 0. If the sprite is positioned so part of it is
-			 * outside the coordinates of the display, it wraps around to the opposite side of the screen.
-			 * See instruction 8xy3 for more information on XOR, and section 2.4, Display, for more
-			 * information on the Chip-8 screen and sprites.
-			 */
-		case 0xD000:
+/*
+ * 9xy0 - SNE Vx, Vy
+ * Skip next instruction if Vx != Vy.
+ * The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
+ */
+static void chip8_op_sne_vx_vy(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	if (chip8->registers.V[instruction->x] != chip8->registers.V[instruction->y])
+	{
+		chip8->registers.PC += 2;
+	}
+}
+
+/*
+ * Annn - LD I, addr
+ * Set I = nnn.
+ * The value of register I is set to nnn.
+ */
+static void chip8_op_ld_i_addr(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.I = instruction->nnn;
+}
+
+/*
+ * Bnnn - JP V0, addr
+ * Jump to location nnn + V0.
+ * The program counter is set to nnn plus the value of V0.
+ */
+static void chip8_op_jp_v0_addr(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.PC = instruction->nnn + chip8->registers.V[0x00];
+}
+
+/*
+ * Cxkk - RND Vx, byte
+ * Set Vx = random byte AND kk.
+ */
+static void chip8_op_rnd_vx_byte(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] = chip8_random_byte(&chip8->random) & instruction->kk;
+}
+
+/*
+ * Dxyn - DRW Vx, Vy, nibble
+ * Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
+ * The interpreter reads n bytes from memory, starting at the address stored in I.
+ * These bytes are then displayed as sprites on screen at coordinates (Vx, Vy).
+ * Sprites are XORed onto the existing screen. If this causes any pixels to be erased,
+ * VF is set to 1, otherwise it is set to 0. If the sprite is positioned so part of it is
+ * outside the coordinates of the display, it wraps around to the opposite side of the screen.
+ * See instruction 8xy3 for more information on XOR, and section 2.4, Display, for more
+ * information on the Chip-8 screen and sprites.
+ */
+static void chip8_op_drw_vx_vy_nibble(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	// copied out because the sprite may straddle a shared and a private page
+	char sprite[15];
+	for (int i = 0; i < instruction->n; i++)
+	{
+		sprite[i] = (char)chip8_memory_get(&chip8->memory, (chip8->registers.I + i) % CHIP8_MEMORY_SIZE);
+	}
+	chip8->registers.V[0x0F] = chip8_screen_draw_sprite(&chip8->screen, chip8->registers.V[instruction->x], chip8->registers.V[instruction->y], sprite, instruction->n);
+}
+
+/*
+ * Ex9E - SKP Vx
+ * Skip next instruction if key with the value of Vx is pressed.
+ * Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
+ */
+static void chip8_op_skp_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	const bool is_down = chip8_keyboard_is_down(&chip8->keyboard, chip8->registers.V[instruction->x]);
+	if (is_down)
+	{
+		chip8->registers.PC += 2;
+	}
+}
+
+/*
+ * ExA1 - SKNP Vx
+ * Skip next instruction if key with the value of Vx is not pressed.
+ * Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
+ */
+static void chip8_op_sknp_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	const bool is_down = chip8_keyboard_is_down(&chip8->keyboard, chip8->registers.V[instruction->x]);
+	if (!is_down)
+	{
+		chip8->registers.PC += 2;
+	}
+}
+
+/*
+ * Fx07 - LD Vx, DT
+ * Set Vx = delay timer value.
+ * The value of DT is placed into Vx.
+ */
+static void chip8_op_ld_vx_dt(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] = chip8->registers.delay_timer;
+}
+
+/*
+ * Fx0A - LD Vx, K
+ * Wait for a key press, store the value of the key in Vx.
+ * All execution stops until a key is pressed, then the value of that key is stored in Vx.
+ * The core never blocks: the first execution puts the keyboard in its waiting state and
+ * returns with PC moved back, so the instruction runs again until chip8_keyboard_down
+ * has latched a press. A key that was already down when the wait started doesn't count.
+ */
+static void chip8_op_ld_vx_k(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	if (!chip8->keyboard.waiting)
+	{
+		chip8_keyboard_wait(&chip8->keyboard);
+	}
+
+	const int key = chip8_keyboard_take_pressed(&chip8->keyboard);
+	if (key < 0)
+	{
+		chip8->registers.PC -= 2;
+		return;
+	}
+
+	chip8->registers.V[instruction->x] = (unsigned char)key;
+}
+
+/*
+ * Fx15 - LD DT, Vx
+ * Set delay timer = Vx.
+ * DT is set equal to the value of Vx.
+ */
+static void chip8_op_ld_dt_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.delay_timer = chip8->registers.V[instruction->x];
+}
+
+/*
+ * Fx18 - LD ST, Vx
+ * Set sound timer = Vx.
+ * ST is set equal to the value of Vx.
+ */
+static void chip8_op_ld_st_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.sound_timer = chip8->registers.V[instruction->x];
+}
+
+/*
+ * Fx1E - ADD I, Vx
+ * Set I = I + Vx.
+ * The values of I and Vx are added, and the results are stored in I.
+ */
+static void chip8_op_add_i_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.I += chip8->registers.V[instruction->x];
+}
+
+/*
+ * Fx29 - LD F, Vx
+ * Set I = location of sprite for digit Vx.
+ * The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx.
+ * See section 2.4, Display, for more information on the Chip-8 hexadecimal font.
+ */
+static void chip8_op_ld_f_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.I = chip8->registers.V[instruction->x] * CHIP8_DEFAULT_SPRITE_HEIGHT;
+}
+
+/*
+ * Fx33 - LD B, Vx
+ * Store BCD representation of Vx in memory locations I, I+1, and I+2.
+ * The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at
+ * location in I, the tens digit at location I+1, and the ones digit at location I+2.
+ */
+static void chip8_op_ld_b_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	const unsigned char hundreds = chip8->registers.V[instruction->x] / 100;
+	const unsigned char tens = chip8->registers.V[instruction->x] / 10 % 10;
+	const unsigned char units = chip8->registers.V[instruction->x] % 10;
+	chip8_store(chip8, chip8->registers.I, hundreds);
+	chip8_store(chip8, chip8->registers.I + 1, tens);
+	chip8_store(chip8, chip8->registers.I + 2, units);
+}
+
+/*
+ * Fx55 - LD [I], Vx
+ * Store registers V0 through Vx in memory starting at location I.
+ * The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
+ */
+static void chip8_op_ld_i_vx(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	for (int i = 0; i <= instruction->x; ++i)
+	{
+		chip8_store(chip8, chip8->registers.I + i, chip8->registers.V[i]);
+	}
+}
+
+/*
+ * Fx65 - LD Vx, [I]
+ * Read registers V0 through Vx from memory starting at location I.
+ * The interpreter reads values from memory starting at location I into registers V0 through Vx.
+ */
+static void chip8_op_ld_vx_i(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	for (int i = 0; i <= instruction->x; ++i)
+	{
+		chip8->registers.V[i] = chip8_memory_get(&chip8->memory, chip8->registers.I + i);
+	}
+}
+
+/*
+ * Annn; Dxyn superinstruction
+ * Set I = nnn, then draw the n-byte sprite at (Vx, Vy).
+ */
+static void chip8_op_ld_i_drw(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8_op_ld_i_addr(chip8, instruction);
+	chip8_op_drw_vx_vy_nibble(chip8, instruction);
+}
+
+/*
+ * Fx07; 3x00; 1nnn superinstruction
+ * Set Vx = delay timer value, then jump to nnn unless it reached 0.
+ * PC already points past the three instructions, which is where the skip would have left it.
+ */
+static void chip8_op_wait_dt(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+	chip8->registers.V[instruction->x] = chip8->registers.delay_timer;
+	if (chip8->registers.V[instruction->x] != 0)
+	{
+		chip8->registers.PC = instruction->nnn;
+	}
+}
+
+// Maps every operation to its handler, in the order of enum chip8_operation
+#define CHIP8_OPERATION_HANDLERS(X) \
+	X(CHIP8_OP_NONE, chip8_op_unknown) \
+	X(CHIP8_OP_CLS, chip8_op_cls) \
+	X(CHIP8_OP_RET, chip8_op_ret) \
+	X(CHIP8_OP_JP_ADDR, chip8_op_jp_addr) \
+	X(CHIP8_OP_CALL_ADDR, chip8_op_call_addr) \
+	X(CHIP8_OP_SE_VX_BYTE, chip8_op_se_vx_byte) \
+	X(CHIP8_OP_SNE_VX_BYTE, chip8_op_sne_vx_byte) \
+	X(CHIP8_OP_SE_VX_VY, chip8_op_se_vx_vy) \
+	X(CHIP8_OP_LD_VX_BYTE, chip8_op_ld_vx_byte) \
+	X(CHIP8_OP_ADD_VX_BYTE, chip8_op_add_vx_byte) \
+	X(CHIP8_OP_LD_VX_VY, chip8_op_ld_vx_vy) \
+	X(CHIP8_OP_OR_VX_VY, chip8_op_or_vx_vy) \
+	X(CHIP8_OP_AND_VX_VY, chip8_op_and_vx_vy) \
+	X(CHIP8_OP_XOR_VX_VY, chip8_op_xor_vx_vy) \
+	X(CHIP8_OP_ADD_VX_VY, chip8_op_add_vx_vy) \
+	X(CHIP8_OP_SUB_VX_VY, chip8_op_sub_vx_vy) \
+	X(CHIP8_OP_SHR_VX, chip8_op_shr_vx) \
+	X(CHIP8_OP_SUBN_VX_VY, chip8_op_subn_vx_vy) \
+	X(CHIP8_OP_SHL_VX, chip8_op_shl_vx) \
+	X(CHIP8_OP_SNE_VX_VY, chip8_op_sne_vx_vy) \
+	X(CHIP8_OP_LD_I_ADDR, chip8_op_ld_i_addr) \
+	X(CHIP8_OP_JP_V0_ADDR, chip8_op_jp_v0_addr) \
+	X(CHIP8_OP_RND_VX_BYTE, chip8_op_rnd_vx_byte) \
+	X(CHIP8_OP_DRW_VX_VY_NIBBLE, chip8_op_drw_vx_vy_nibble) \
+	X(CHIP8_OP_SKP_VX, chip8_op_skp_vx) \
+	X(CHIP8_OP_SKNP_VX, chip8_op_sknp_vx) \
+	X(CHIP8_OP_LD_VX_DT, chip8_op_ld_vx_dt) \
+	X(CHIP8_OP_LD_VX_K, chip8_op_ld_vx_k) \
+	X(CHIP8_OP_LD_DT_VX, chip8_op_ld_dt_vx) \
+	X(CHIP8_OP_LD_ST_VX, chip8_op_ld_st_vx) \
+	X(CHIP8_OP_ADD_I_VX, chip8_op_add_i_vx) \
+	X(CHIP8_OP_LD_F_VX, chip8_op_ld_f_vx) \
+	X(CHIP8_OP_LD_B_VX, chip8_op_ld_b_vx) \
+	X(CHIP8_OP_LD_I_VX, chip8_op_ld_i_vx) \
+	X(CHIP8_OP_LD_VX_I, chip8_op_ld_vx_i) \
+	X(CHIP8_OP_LD_I_DRW, chip8_op_ld_i_drw) \
+	X(CHIP8_OP_WAIT_DT, chip8_op_wait_dt) \
+	X(CHIP8_OP_UNKNOWN, chip8_op_unknown)
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_TABLE || CHIP8_DISPATCH == CHIP8_DISPATCH_GOTO
+typedef void (*chip8_operation_handler)(struct chip8* chip8, const struct chip8_instruction* instruction);
+
+#define CHIP8_HANDLER_ENTRY(operation, handler) [operation] = handler,
+static const chip8_operation_handler chip8_operation_handlers[CHIP8_TOTAL_OPERATIONS] = {
+	CHIP8_OPERATION_HANDLERS(CHIP8_HANDLER_ENTRY)
+};
+#undef CHIP8_HANDLER_ENTRY
+#endif
+
+static void chip8_execute(struct chip8* chip8, const struct chip8_instruction* instruction)
+{
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_SWITCH
+	// the current path: a single switch over the decoded operation
+#define CHIP8_HANDLER_CASE(operation, handler) case operation: handler(chip8, instruction); break;
+	switch (instruction->operation)
+	{
+		CHIP8_OPERATION_HANDLERS(CHIP8_HANDLER_CASE)
+		default:
+			chip8_op_unknown(chip8, instruction);
+	}
+#undef CHIP8_HANDLER_CASE
+#else
+	// one indirect call through the handler table
+	chip8_operation_handlers[instruction->operation](chip8, instruction);
+#endif
+}
+
+void chip8_exec(struct chip8* chip8, const unsigned short opcode)
+{
+	const struct chip8_instruction instruction = chip8_decode(opcode);
+	chip8_execute(chip8, &instruction);
+}
+
+void chip8_image_init(struct chip8_memory_image* image, const char* buf, const size_t size)
+{
+	assert(size + CHIP8_PROGRAM_LOAD_ADDRESS < CHIP8_MEMORY_SIZE);
+	*image = chip8_empty_image;
+	memcpy(&image->memory[CHIP8_PROGRAM_LOAD_ADDRESS], buf, size);
+	image->hash = 0xCBF29CE484222325ULL;
+	for (int i = 0; i < CHIP8_MEMORY_SIZE; i++)
+	{
+		image->hash ^= image->memory[i];
+		image->hash *= 0x100000001B3ULL;
+	}
+
+	// decoded once for every instance running the image, the last byte starts no whole instruction
+	for (int i = 0; i + 1 < CHIP8_MEMORY_SIZE; i++)
+	{
+		image->decoded[i] = chip8_decode(image->memory[i] << 8 | image->memory[i + 1]);
+	}
+}
+
+void chip8_load_image(struct chip8* chip8, const struct chip8_memory_image* image)
+{
+	chip8_memory_map(&chip8->memory, image);
+	chip8_decode_cache_clear(&chip8->decode_cache);
+	if (chip8->block_cache != NULL)
+	{
+		chip8_block_cache_clear(chip8->block_cache);
+	}
+	if (chip8->jit != NULL)
+	{
+		chip8_jit_clear(chip8->jit);
+	}
+	chip8->registers.PC = CHIP8_PROGRAM_LOAD_ADDRESS;
+	chip8->keyboard.waiting = false;
+}
+
+void chip8_load(struct chip8* chip8, const char* buf, const size_t size)
+{
+	if (chip8->image == NULL)
+	{
+		chip8->image = malloc(sizeof(struct chip8_memory_image));
+		if (chip8->image == NULL)
 		{
-			const char* sprite = (const char*)&chip8->memory.memory[chip8->registers.I];
-			chip8->registers.V[0x0F] = chip8_screen_draw_sprite(&chip8->screen, chip8->registers.V[x], chip8->registers.V[y], sprite, n);
+			abort();
 		}
-		break;
+	}
+	chip8_image_init(chip8->image, buf, size);
+	chip8_load_image(chip8, chip8->image);
+}
 
-		case 0xE000:
-			switch (opcode & 0x00FF)
-			{
-				/*
-				 * Ex9E - SKP Vx
-				 * Skip next instruction if key with the value of Vx is pressed.
-				 * Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
-				 */
-				case 0x9E:
-				{
-					const bool is_down = chip8_keyboard_is_down(&chip8->keyboard, chip8->registers.V[x]);
-					if (is_down)
-					{
-						chip8->registers.PC += 2;
-					}
-				}
-				break;
-
-				/*
-				 * ExA1 - SKNP Vx
-				 * Skip next instruction if key with the value of Vx is not pressed.
-				 * Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
-				 */
-				case 0xA1:
-				{
-					const bool is_down = chip8_keyboard_is_down(&chip8->keyboard, chip8->registers.V[x]);
-					if (!is_down)
-					{
-						chip8->registers.PC += 2;
-					}
-				}
-				break;
-				default:
-					puts("opcode not supported");
-			}
+/*
+	The instruction at PC. The interpreter's fast path: while the instance hasn't written the
+	memory it was decoded from, that's the entry of the shared image, without a call.
+ */
+static const struct chip8_instruction* chip8_fetch(struct chip8* chip8)
+{
+	const int pc = chip8->registers.PC;
+	// a jump, a return or Bnnn can leave PC anywhere, and an instruction takes 2 bytes
+	assert(pc >= 0 && pc + 1 < CHIP8_MEMORY_SIZE);
+	const struct chip8_instruction* instruction = &chip8->memory.image->decoded[pc];
+	if ((chip8->memory.written_pages & (3ULL << (pc / CHIP8_MEMORY_PAGE_SIZE))) == 0 && instruction->operation != CHIP8_OP_NONE)
+	{
+		return instruction;
+	}
+	return chip8_decode_cache_fetch(&chip8->decode_cache, &chip8->memory, pc);
+}
+
+/*
+	Fetches the instruction at PC, advances PC past it and executes it.
+	Instructions are decoded once and then served from the decode cache.
+ */
+void chip8_step(struct chip8* chip8)
+{
+	// copied because executing the instruction may invalidate its own cache entry
+	const struct chip8_instruction instruction = *chip8_fetch(chip8);
+	chip8->registers.PC += 2;
+	chip8_execute(chip8, &instruction);
+}
+
+/*
+	The delay and sound timers count down at 60Hz while they are non-zero.
+	This must be called exactly once per frame.
+ */
+void chip8_tick_timers(struct chip8* chip8)
+{
+	if (chip8->registers.delay_timer > 0)
+	{
+		chip8->registers.delay_timer -= 1;
+	}
+
+	if (chip8->registers.sound_timer > 0)
+	{
+		chip8->registers.sound_timer -= 1;
+	}
+}
+
+/*
+	When built with CHIP8_DISPATCH_GOTO this is a threaded interpreter: every handler
+	is followed by its own copy of the fetch and indirect jump to the next handler,
+	so the branch predictor gets one branch per operation instead of a shared one.
+ */
+static void chip8_run_interpreter(struct chip8* chip8, int instructions)
+{
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_GOTO
+#define CHIP8_HANDLER_LABEL(operation, handler) [operation] = &&label_##operation,
+	static void* const labels[CHIP8_TOTAL_OPERATIONS] = {
+		CHIP8_OPERATION_HANDLERS(CHIP8_HANDLER_LABEL)
+	};
+#undef CHIP8_HANDLER_LABEL
+
+	struct chip8_instruction instruction;
+
+#define CHIP8_DISPATCH_NEXT() \
+	do { \
+		if (instructions-- <= 0) \
+		{ \
+			return; \
+		} \
+		instruction = *chip8_fetch(chip8); \
+		chip8->registers.PC += 2; \
+		goto *labels[instruction.operation]; \
+	} while (0)
+
+	CHIP8_DISPATCH_NEXT();
+
+#define CHIP8_HANDLER_BODY(operation, handler) \
+	label_##operation: \
+		handler(chip8, &instruction); \
+		CHIP8_DISPATCH_NEXT();
+	CHIP8_OPERATION_HANDLERS(CHIP8_HANDLER_BODY)
+#undef CHIP8_HANDLER_BODY
+#undef CHIP8_DISPATCH_NEXT
+#else
+	for (int i = 0; i < instructions; i++)
+	{
+		chip8_step(chip8);
+	}
+#endif
+}
+
+// Returns the number of guest instructions executed
+static int chip8_run_block(struct chip8* chip8, const struct chip8_block* block)
+{
+	// copied because the last instruction (Fx33, Fx55) may store into the block and clear the cache
+	const int length = block->length;
+	const struct chip8_instruction last = block->instructions[length - 1];
+	int executed = 0;
+	for (int i = 0; i < length - 1; i++)
+	{
+		const struct chip8_instruction* instruction = &block->instructions[i];
+		chip8->registers.PC += 2 * instruction->length;
+		chip8_execute(chip8, instruction);
+		executed += instruction->length;
+	}
+	chip8->registers.PC += 2 * last.length;
+	chip8_execute(chip8, &last);
+	executed += last.length;
+
+	// when the delay timer ran out the wait loop skipped its jump, so only two instructions were executed
+	if (last.operation == CHIP8_OP_WAIT_DT && chip8->registers.V[last.x] == 0)
+	{
+		executed -= 1;
+	}
+
+	return executed;
+}
+
+static void chip8_run_blocks(struct chip8* chip8, int instructions)
+{
+	while (instructions > 0)
+	{
+		const struct chip8_block* block = chip8_block_cache_fetch(chip8->block_cache, &chip8->decode_cache, &chip8->memory, chip8->registers.PC);
+
+		// never run past the requested number of instructions, finish one at a time instead
+		if (block->guest_instructions > instructions)
+		{
+			chip8_step(chip8);
+			instructions -= 1;
+			continue;
+		}
+
+		instructions -= chip8_run_block(chip8, block);
+	}
+}
+
+static void chip8_run_jit(struct chip8* chip8, int instructions)
+{
+	while (instructions > 0)
+	{
+		const struct chip8_jit_block* block = chip8_jit_fetch(chip8->jit, chip8, chip8->registers.PC);
+
+		// instructions without a native translation are interpreted one at a time
+		if (block == NULL || block->instructions > instructions)
+		{
+			chip8_step(chip8);
+			instructions -= 1;
+			continue;
+		}
+
+		block->function(chip8);
+		instructions -= block->instructions;
+	}
+}
+
+/*
+	Executes the given number of instructions with the selected engine.
+ */
+void chip8_run(struct chip8* chip8, const int instructions)
+{
+	switch (chip8->engine)
+	{
+		case CHIP8_ENGINE_BLOCKS:
+			chip8_run_blocks(chip8, instructions);
 			break;
 
-		case 0xF000:
-			switch (opcode & 0x00FF)
-			{
-				/*
-				 * Fx07 - LD Vx, DT
-				 * Set Vx = delay timer value.
-				 * The value of DT is placed into Vx.
-				 */
-				case 0x07:
-					chip8->registers.V[x] = chip8->registers.delay_timer;
-					break;
-
-					/*
-					 * Fx0A - LD Vx, K
-					 * Wait for a key press, store the value of the key in Vx.
-					 * All execution stops until a key is pressed, then the value of that key is stored in Vx.
-					 */
-				case 0x0A:
-					chip8->registers.V[x] = chip8_wait_for_key_press(chip8);
-					break;
-
-					/*
-					 * Fx15 - LD DT, Vx
-					 * Set delay timer = Vx.
-					 * DT is set equal to the value of Vx.
-					 */
-				case 0x15:
-					chip8->registers.delay_timer = chip8->registers.V[x];
-					break;
-
-					/*
-					 * Fx18 - LD ST, Vx
-					 * Set sound timer = Vx.
-					 * ST is set equal to the value of Vx.
-					 */
-				case 0x18:
-					chip8->registers.sound_timer = chip8->registers.V[x];
-					break;
-
-					/*
-					 * Fx1E - ADD I, Vx
-					 * Set I = I + Vx.
-					 * The values of I and Vx are added, and the results are stored in I.
-					 */
-				case 0x1E:
-					chip8->registers.I += chip8->registers.V[x];
-					break;
-
-					/*
-					 * Fx29 - LD F, Vx
-					 * Set I = location of sprite for digit Vx.
-					 * The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx.
-					 * See section 2.4, Display, for more information on the Chip-8 hexadecimal font.
-					 */
-				case 0x29:
-					chip8->registers.I = chip8->registers.V[x] * CHIP8_DEFAULT_SPRITE_HEIGHT;
-					break;
-
-					/*
-					 * Fx33 - LD B, Vx
-					 * Store BCD representation of Vx in memory locations I, I+1, and I+2.
-					 * The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at
-					 * location in I, the tens digit at location I+1, and the ones digit at location I+2.
-					 */
-				case 0x33:
-				{
-					const unsigned char hundreds = chip8->registers.V[x] / 100;
-					const unsigned char tens = chip8->registers.V[x] / 10 % 10;
-					const unsigned char units = chip8->registers.V[x] % 10;
-					chip8_memory_set(&chip8->memory, chip8->registers.I, hundreds);
-					chip8_memory_set(&chip8->memory, chip8->registers.I + 1, tens);
-					chip8_memory_set(&chip8->memory, chip8->registers.I + 2, units);
-				}
-				break;
-
-				/*
-				 * Fx55 - LD [I], Vx
-				 * Store registers V0 through Vx in memory starting at location I.
-				 * The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
-				 */
-				case 0x55:
-				{
-					for (int i = 0; i <= x; ++i)
-					{
-						chip8_memory_set(&chip8->memory, chip8->registers.I + i, chip8->registers.V[i]);
-					}
-					break;
-				}
-				/*
-				 * Fx65 - LD Vx, [I]
-				 * Read registers V0 through Vx from memory starting at location I.
-				 * The interpreter reads values from memory starting at location I into registers V0 through Vx.
-				 */
-				case 0x65:
-				{
-					for (int i = 0; i <= x; ++i)
-					{
-						chip8->registers.V[i] = chip8_memory_get(&chip8->memory, chip8->registers.I + i);
-					}
-				}
-				break;
-
-				default:
-					puts("opcode not supported");
-			}
+		case CHIP8_ENGINE_JIT:
+			chip8_run_jit(chip8, instructions);
 			break;
 
+		case CHIP8_ENGINE_INTERPRETER:
 		default:
-			puts("opcode not supported");
+			chip8_run_interpreter(chip8, instructions);
+			break;
 	}
 }
 
-void chip8_exec(struct chip8* chip8, const unsigned short opcode)
+void chip8_set_instructions_per_tick(struct chip8* chip8, const int instructions_per_tick)
 {
-	switch (opcode)
+	assert(instructions_per_tick > 0);
+	chip8->clock.instructions_per_tick = instructions_per_tick;
+	chip8->clock.until_tick = instructions_per_tick;
+}
+
+static struct chip8_instruction chip8_instruction_at(const struct chip8* chip8, const int address)
+{
+	return chip8_decode(chip8_memory_get_short(&chip8->memory, address));
+}
+
+enum chip8_activity chip8_activity(const struct chip8* chip8)
+{
+	const int PC = chip8->registers.PC;
+	if (PC + 2 > CHIP8_MEMORY_SIZE)
 	{
-		// 00E0 - CLS
-		// Clear the display.
-		case 0x00E0:
-			chip8_screen_clear(&chip8->screen);
-			break;
+		return CHIP8_RUNNING;
+	}
 
-			// 00EE - RET
-			// Return from a subroutine.
-			// The interpreter sets the program counter to the address at the top of the stack, then subtracts 1 from the stack pointer.
-		case 0x00EE:
-			chip8->registers.PC = chip8_stack_pop(chip8);
-			break;
+	const struct chip8_instruction first = chip8_instruction_at(chip8, PC);
+	switch (first.operation)
+	{
+		case CHIP8_OP_JP_ADDR:
+			return first.nnn == PC ? CHIP8_HALTED : CHIP8_RUNNING;
+
+		case CHIP8_OP_LD_VX_K:
+			// before its first execution the instruction still has to start the wait
+			return chip8->keyboard.waiting && chip8->keyboard.pressed_key < 0 ? CHIP8_WAITING_KEY : CHIP8_RUNNING;
+
+		case CHIP8_OP_LD_VX_DT:
+		{
+			// the loop only exits on the instruction after the timer reaches 0
+			if (chip8->registers.delay_timer == 0 || PC + 6 > CHIP8_MEMORY_SIZE)
+			{
+				return CHIP8_RUNNING;
+			}
+			const struct chip8_instruction skip = chip8_instruction_at(chip8, PC + 2);
+			const struct chip8_instruction jump = chip8_instruction_at(chip8, PC + 4);
+			const bool waits = skip.operation == CHIP8_OP_SE_VX_BYTE && skip.x == first.x && skip.kk == 0
+				&& jump.operation == CHIP8_OP_JP_ADDR && jump.nnn == PC;
+			return waits ? CHIP8_IDLE : CHIP8_RUNNING;
+		}
 
 		default:
-			chip8_exec_extended(chip8, opcode);
+			return CHIP8_RUNNING;
 	}
 }
 
-void chip8_load(struct chip8* chip8, const char* buf, const size_t size)
+/*
+	Leaves the instance as running the idle loop at PC for the given number of instructions
+	would, provided the timers don't tick in the meantime. Only Fx07; 3x00; 1nnn changes
+	anything: Vx, and PC when stopping partway through the loop.
+ */
+static void chip8_fast_forward(struct chip8* chip8, const int instructions)
 {
-	assert(size + CHIP8_PROGRAM_LOAD_ADDRESS < CHIP8_MEMORY_SIZE);
-	memcpy(&chip8->memory.memory[CHIP8_PROGRAM_LOAD_ADDRESS], buf, size);
-	chip8->registers.PC = CHIP8_PROGRAM_LOAD_ADDRESS;
+	const struct chip8_instruction first = chip8_instruction_at(chip8, chip8->registers.PC);
+	if (first.operation == CHIP8_OP_LD_VX_DT)
+	{
+		chip8->registers.V[first.x] = chip8->registers.delay_timer;
+		chip8->registers.PC += 2 * (instructions % 3);
+	}
+}
+
+void chip8_advance(struct chip8* chip8, int instructions)
+{
+	while (instructions > 0)
+	{
+		// never run past the next tick, so the timers tick at the same instruction however the run is split up
+		const int run = instructions < chip8->clock.until_tick ? instructions : chip8->clock.until_tick;
+		if (chip8_activity(chip8) == CHIP8_RUNNING)
+		{
+			chip8_run(chip8, run);
+		}
+		else
+		{
+			chip8_fast_forward(chip8, run);
+			chip8->clock.idle_instructions += run;
+		}
+		instructions -= run;
+		chip8->clock.instructions += run;
+		chip8->clock.until_tick -= run;
+
+		if (chip8->clock.until_tick == 0)
+		{
+			chip8_tick_timers(chip8);
+			chip8->clock.ticks++;
+			chip8->clock.until_tick = chip8->clock.instructions_per_tick;
+		}
+	}
 }
@@ -2,13 +2,40 @@
 #define  CHIP8_H
 
 #include "config.h"
+#include "chip8_clock.h"
 #include "chip8_memory.h"
 #include "chip8_registers.h"
 #include "chip8_stack.h"
 #include "chip8_keyboard.h"
+#include "chip8_random.h"
 #include "chip8_screen.h"
+#include "chip8_decoder.h"
+#include "chip8_block.h"
+#include "chip8_jit.h"
 #include <stddef.h>
 
+enum chip8_engine
+{
+	// Fetches, decodes (through the decode cache) and executes one instruction at a time
+	CHIP8_ENGINE_INTERPRETER = 0,
+	// Translates basic blocks with superinstructions and runs a whole block at a time
+	CHIP8_ENGINE_BLOCKS,
+	// Compiles basic blocks to x86-64 code, falling back to the interpreter for the rest
+	CHIP8_ENGINE_JIT
+};
+
+// What the program is doing, as far as the host is concerned
+enum chip8_activity
+{
+	CHIP8_RUNNING = 0,
+	// Spinning until the delay timer runs out (Fx07; 3x00; 1nnn)
+	CHIP8_IDLE,
+	// Stopped on Fx0A until chip8_keyboard_down delivers a key press
+	CHIP8_WAITING_KEY,
+	// Spinning on a jump to itself: nothing but the timers will ever change again
+	CHIP8_HALTED
+};
+
 struct chip8
 {
 	struct chip8_memory memory;
@@ -16,11 +43,43 @@ struct chip8
 	struct chip8_stack stack;
 	struct chip8_keyboard keyboard;
 	struct chip8_screen screen;
+	struct chip8_random random;
+	struct chip8_clock clock;
+	struct chip8_decode_cache decode_cache;
+	enum chip8_engine engine;
+	// Only allocated while the blocks engine is selected
+	struct chip8_block_cache* block_cache;
+	// Only allocated while the JIT engine is selected
+	struct chip8_jit* jit;
+	// The image chip8_load built, NULL when running from a shared image
+	struct chip8_memory_image* image;
 };
 
 void chip8_init(struct chip8* chip8);
+void chip8_destroy(struct chip8* chip8);
+// Restarts the sequence of random numbers returned by Cxkk
+void chip8_seed(struct chip8* chip8, unsigned long long seed);
+// Returns false, keeping the current engine, when the engine is not available on this host
+bool chip8_set_engine(struct chip8* chip8, enum chip8_engine engine);
 void chip8_exec(struct chip8* chip8, unsigned short opcode);
 void chip8_load(struct chip8* chip8, const char* buf, size_t size);
+// Builds the font and program image chip8_load_image shares between instances
+void chip8_image_init(struct chip8_memory_image* image, const char* buf, size_t size);
+// Like chip8_load, without copying the program: memory reads come from the image, which must outlive the instance
+void chip8_load_image(struct chip8* chip8, const struct chip8_memory_image* image);
+void chip8_step(struct chip8* chip8);
+void chip8_run(struct chip8* chip8, int instructions);
+void chip8_tick_timers(struct chip8* chip8);
+// Instructions the virtual clock counts per timer tick, CHIP8_INSTRUCTIONS_PER_FRAME after chip8_init
+void chip8_set_instructions_per_tick(struct chip8* chip8, int instructions_per_tick);
+/*
+	Runs the given number of instructions and ticks the timers whenever the virtual clock reaches a tick.
+	While the program is idle or halted the instructions are fast-forwarded over rather than executed,
+	with the same result.
+ */
+void chip8_advance(struct chip8* chip8, int instructions);
+// Recognizes the idle loops at PC
+enum chip8_activity chip8_activity(const struct chip8* chip8);
 
 #endif
 
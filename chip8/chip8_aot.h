@@ -0,0 +1,26 @@
+#ifndef CHIP8_AOT_H
+#define CHIP8_AOT_H
+
+#include <stddef.h>
+
+/*
+	Interface of the C translation units generated by chip8c, the ahead-of-time compiler.
+
+	chip8c analyzes the control flow of a ROM starting at CHIP8_PROGRAM_LOAD_ADDRESS and
+	emits one C function per reachable basic block. Link the generated file together with
+	the emulator core, load chip8_aot_rom with chip8_load and call chip8_aot_run instead of
+	chip8_run.
+
+	chip8_aot_run falls back to the interpreter whenever PC is not the start of a compiled
+	block (indirect Bnnn jumps into unknown code, for instance) or when the program has
+	written to the memory a block was compiled from.
+ */
+
+struct chip8;
+
+extern const char chip8_aot_rom[];
+extern const size_t chip8_aot_rom_size;
+
+void chip8_aot_run(struct chip8* chip8, int instructions);
+
+#endif
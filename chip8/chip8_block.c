@@ -0,0 +1,137 @@
+#include "chip8_block.h"
+#include <assert.h>
+#include <memory.h>
+
+static bool chip8_block_is_terminator(const unsigned char operation)
+{
+	switch (operation)
+	{
+		case CHIP8_OP_RET:
+		case CHIP8_OP_JP_ADDR:
+		case CHIP8_OP_CALL_ADDR:
+		case CHIP8_OP_JP_V0_ADDR:
+		case CHIP8_OP_SE_VX_BYTE:
+		case CHIP8_OP_SNE_VX_BYTE:
+		case CHIP8_OP_SE_VX_VY:
+		case CHIP8_OP_SNE_VX_VY:
+		case CHIP8_OP_SKP_VX:
+		case CHIP8_OP_SKNP_VX:
+		case CHIP8_OP_LD_VX_K:
+		case CHIP8_OP_LD_B_VX:
+		case CHIP8_OP_LD_I_VX:
+		case CHIP8_OP_WAIT_DT:
+		case CHIP8_OP_UNKNOWN:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool chip8_block_has_instruction(const int address)
+{
+	return address + 1 < CHIP8_MEMORY_SIZE;
+}
+
+/*
+	Tries to fuse the instruction at address with the ones following it.
+	Returns the instruction to execute, with length set to the number of instructions it covers.
+ */
+static struct chip8_instruction chip8_block_fuse(struct chip8_decode_cache* decode_cache, const struct chip8_memory* memory, const int address)
+{
+	struct chip8_instruction instruction = *chip8_decode_cache_fetch(decode_cache, memory, address);
+	if (!chip8_block_has_instruction(address + 2))
+	{
+		return instruction;
+	}
+
+	const struct chip8_instruction* next = chip8_decode_cache_fetch(decode_cache, memory, address + 2);
+
+	// 6xkk; 7xkk - the register ends up holding the sum of both bytes
+	if (instruction.operation == CHIP8_OP_LD_VX_BYTE && next->operation == CHIP8_OP_ADD_VX_BYTE && next->x == instruction.x)
+	{
+		instruction.kk += next->kk;
+		instruction.length = 2;
+		return instruction;
+	}
+
+	// Annn; Dxyn
+	if (instruction.operation == CHIP8_OP_LD_I_ADDR && next->operation == CHIP8_OP_DRW_VX_VY_NIBBLE)
+	{
+		instruction.operation = CHIP8_OP_LD_I_DRW;
+		instruction.x = next->x;
+		instruction.y = next->y;
+		instruction.n = next->n;
+		instruction.length = 2;
+		return instruction;
+	}
+
+	// Fx07; 3x00; 1nnn
+	if (instruction.operation == CHIP8_OP_LD_VX_DT && next->operation == CHIP8_OP_SE_VX_BYTE && next->x == instruction.x && next->kk == 0
+		&& chip8_block_has_instruction(address + 4))
+	{
+		const struct chip8_instruction* jump = chip8_decode_cache_fetch(decode_cache, memory, address + 4);
+		if (jump->operation == CHIP8_OP_JP_ADDR)
+		{
+			instruction.operation = CHIP8_OP_WAIT_DT;
+			instruction.nnn = jump->nnn;
+			instruction.length = 3;
+			return instruction;
+		}
+	}
+
+	return instruction;
+}
+
+static void chip8_block_translate(struct chip8_block_cache* cache, struct chip8_block* block, struct chip8_decode_cache* decode_cache, const struct chip8_memory* memory, const int index)
+{
+	block->valid = true;
+	block->start = index;
+	block->length = 0;
+	block->guest_instructions = 0;
+
+	int address = index;
+	while (block->length < CHIP8_BLOCK_MAX_INSTRUCTIONS && chip8_block_has_instruction(address))
+	{
+		const struct chip8_instruction instruction = chip8_block_fuse(decode_cache, memory, address);
+		block->instructions[block->length++] = instruction;
+		block->guest_instructions += instruction.length;
+		address += 2 * instruction.length;
+
+		if (chip8_block_is_terminator(instruction.operation))
+		{
+			break;
+		}
+	}
+
+	for (int region = index / CHIP8_BLOCK_REGION_SIZE; region <= (address - 1) / CHIP8_BLOCK_REGION_SIZE; region++)
+	{
+		cache->code_regions |= 1ULL << region;
+	}
+}
+
+const struct chip8_block* chip8_block_cache_fetch(struct chip8_block_cache* cache, struct chip8_decode_cache* decode_cache, const struct chip8_memory* memory, const int index)
+{
+	assert(chip8_block_has_instruction(index));
+	struct chip8_block* block = &cache->blocks[(index >> 1) % CHIP8_BLOCK_CACHE_SIZE];
+	if (!block->valid || block->start != index)
+	{
+		chip8_block_translate(cache, block, decode_cache, memory, index);
+	}
+
+	return block;
+}
+
+void chip8_block_cache_invalidate(struct chip8_block_cache* cache, const int index)
+{
+	// the byte also belongs to an instruction starting right before it, which may be in the previous region
+	const unsigned long long regions = 1ULL << (index / CHIP8_BLOCK_REGION_SIZE) | (index > 0 ? 1ULL << ((index - 1) / CHIP8_BLOCK_REGION_SIZE) : 0);
+	if (cache->code_regions & regions)
+	{
+		chip8_block_cache_clear(cache);
+	}
+}
+
+void chip8_block_cache_clear(struct chip8_block_cache* cache)
+{
+	memset(cache, 0, sizeof(struct chip8_block_cache));
+}
@@ -0,0 +1,50 @@
+#ifndef CHIP8_BLOCK_H
+#define CHIP8_BLOCK_H
+
+#include <stdbool.h>
+#include "config.h"
+#include "chip8_decoder.h"
+#include "chip8_memory.h"
+
+/*
+	A basic block is a run of instructions that is always executed from the first to
+	the last one. Blocks end at instructions that can change the flow of execution
+	(1nnn, 2nnn, 00EE, Bnnn, the skips and Fx0A), at instructions that write memory
+	(Fx33, Fx55), because they could overwrite the rest of the block, and at
+	CHIP8_BLOCK_MAX_INSTRUCTIONS.
+
+	Blocks are translated once, cached by their start address and then executed as a
+	single unit. While translating, common instruction sequences are fused into
+	superinstructions:
+
+	6xkk; 7xkk			becomes	6xkk with the two bytes added together
+	Annn; Dxyn			becomes	CHIP8_OP_LD_I_DRW
+	Fx07; 3x00; 1nnn	becomes	CHIP8_OP_WAIT_DT
+
+	The cache is direct mapped. Writes to memory that holds a cached block flush the
+	cache, which keeps self-modifying programs correct.
+ */
+
+struct chip8_block
+{
+	bool valid;
+	unsigned short start;
+	// Number of entries in instructions
+	unsigned char length;
+	// Number of guest instructions executed when running the whole block
+	unsigned char guest_instructions;
+	struct chip8_instruction instructions[CHIP8_BLOCK_MAX_INSTRUCTIONS];
+};
+
+struct chip8_block_cache
+{
+	struct chip8_block blocks[CHIP8_BLOCK_CACHE_SIZE];
+	// One bit per CHIP8_BLOCK_REGION_SIZE bytes of memory holding the code of a cached block
+	unsigned long long code_regions;
+};
+
+const struct chip8_block* chip8_block_cache_fetch(struct chip8_block_cache* cache, struct chip8_decode_cache* decode_cache, const struct chip8_memory* memory, int index);
+void chip8_block_cache_invalidate(struct chip8_block_cache* cache, int index);
+void chip8_block_cache_clear(struct chip8_block_cache* cache);
+
+#endif
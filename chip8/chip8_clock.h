@@ -0,0 +1,26 @@
+#ifndef CHIP8_CLOCK_H
+#define CHIP8_CLOCK_H
+
+/*
+	The virtual clock: time is measured in executed instructions rather than read
+	from the host. Every instructions_per_tick instructions the delay and sound timers
+	tick once, which stands for 1/60th of a second.
+
+	Headless runs go as fast as the host allows and still see the timers count down
+	at the right rate relative to the program; a real-time frontend only has to
+	run one tick's worth of instructions every 1/60th of a second of wall time.
+ */
+
+struct chip8_clock
+{
+	int instructions_per_tick;
+	// Instructions left to run before the next tick
+	int until_tick;
+	// Since chip8_init
+	unsigned long long instructions;
+	unsigned long long ticks;
+	// Of those instructions, the ones fast-forwarded over while the program was idle
+	unsigned long long idle_instructions;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "chip8_decoder.h"
+#include <assert.h>
+#include <memory.h>
+#include <stdlib.h>
+#include "chip8_memory.h"
+
+static enum chip8_operation chip8_decode_operation(const unsigned short opcode)
+{
+	switch (opcode)
+	{
+		case 0x00E0:
+			return CHIP8_OP_CLS;
+		case 0x00EE:
+			return CHIP8_OP_RET;
+		default:
+			break;
+	}
+
+	// the first 4 bits represent the opcode
+	switch (opcode & 0xF000)
+	{
+		case 0x1000:
+			return CHIP8_OP_JP_ADDR;
+		case 0x2000:
+			return CHIP8_OP_CALL_ADDR;
+		case 0x3000:
+			return CHIP8_OP_SE_VX_BYTE;
+		case 0x4000:
+			return CHIP8_OP_SNE_VX_BYTE;
+		case 0x5000:
+			return CHIP8_OP_SE_VX_VY;
+		case 0x6000:
+			return CHIP8_OP_LD_VX_BYTE;
+		case 0x7000:
+			return CHIP8_OP_ADD_VX_BYTE;
+
+		case 0x8000:
+			switch (opcode & 0x000F)
+			{
+				case 0x0000:
+					return CHIP8_OP_LD_VX_VY;
+				case 0x0001:
+					return CHIP8_OP_OR_VX_VY;
+				case 0x0002:
+					return CHIP8_OP_AND_VX_VY;
+				case 0x0003:
+					return CHIP8_OP_XOR_VX_VY;
+				case 0x0004:
+					return CHIP8_OP_ADD_VX_VY;
+				case 0x0005:
+					return CHIP8_OP_SUB_VX_VY;
+				case 0x0006:
+					return CHIP8_OP_SHR_VX;
+				case 0x0007:
+					return CHIP8_OP_SUBN_VX_VY;
+				case 0x000E:
+					return CHIP8_OP_SHL_VX;
+				default:
+					return CHIP8_OP_UNKNOWN;
+			}
+
+		case 0x9000:
+			return CHIP8_OP_SNE_VX_VY;
+		case 0xA000:
+			return CHIP8_OP_LD_I_ADDR;
+		case 0xB000:
+			return CHIP8_OP_JP_V0_ADDR;
+		case 0xC000:
+			return CHIP8_OP_RND_VX_BYTE;
+		case 0xD000:
+			return CHIP8_OP_DRW_VX_VY_NIBBLE;
+
+		case 0xE000:
+			switch (opcode & 0x00FF)
+			{
+				case 0x9E:
+					return CHIP8_OP_SKP_VX;
+				case 0xA1:
+					return CHIP8_OP_SKNP_VX;
+				default:
+					return CHIP8_OP_UNKNOWN;
+			}
+
+		case 0xF000:
+			switch (opcode & 0x00FF)
+			{
+				case 0x07:
+					return CHIP8_OP_LD_VX_DT;
+				case 0x0A:
+					return CHIP8_OP_LD_VX_K;
+				case 0x15:
+					return CHIP8_OP_LD_DT_VX;
+				case 0x18:
+					return CHIP8_OP_LD_ST_VX;
+				case 0x1E:
+					return CHIP8_OP_ADD_I_VX;
+				case 0x29:
+					return CHIP8_OP_LD_F_VX;
+				case 0x33:
+					return CHIP8_OP_LD_B_VX;
+				case 0x55:
+					return CHIP8_OP_LD_I_VX;
+				case 0x65:
+					return CHIP8_OP_LD_VX_I;
+				default:
+					return CHIP8_OP_UNKNOWN;
+			}
+
+		default:
+			return CHIP8_OP_UNKNOWN;
+	}
+}
+
+struct chip8_instruction chip8_decode(const unsigned short opcode)
+{
+	struct chip8_instruction instruction;
+	instruction.operation = (unsigned char)chip8_decode_operation(opcode);
+	instruction.nnn = opcode & 0x0FFF;
+	instruction.kk = opcode & 0x00FF;
+	instruction.n = opcode & 0x000F;
+	instruction.x = (opcode >> 8) & 0x000F;
+	instruction.y = (opcode >> 4) & 0x000F;
+	instruction.length = 1;
+	return instruction;
+}
+
+// The entry of index in the private page of slot, growing the entries to cover the slot
+static struct chip8_instruction* chip8_decode_cache_private_entry(struct chip8_decode_cache* cache, const int slot, const int index)
+{
+	if (slot >= cache->total_private_pages)
+	{
+		// Grows in powers of two like the private pages, the new entries are not decoded yet
+		int total = cache->total_private_pages == 0 ? 1 : cache->total_private_pages;
+		while (total <= slot)
+		{
+			total *= 2;
+		}
+
+		void* entries = realloc(cache->private_entries, (size_t)total * sizeof(*cache->private_entries));
+		if (entries == NULL)
+		{
+			abort();
+		}
+		cache->private_entries = entries;
+		memset(cache->private_entries[cache->total_private_pages], 0, (size_t)(total - cache->total_private_pages) * sizeof(*cache->private_entries));
+		cache->total_private_pages = total;
+	}
+
+	return &cache->private_entries[slot][index % CHIP8_MEMORY_PAGE_SIZE];
+}
+
+// Fetches from a page the instance wrote, or an instruction ending on one
+static const struct chip8_instruction* chip8_decode_cache_fetch_written(struct chip8_decode_cache* cache, const struct chip8_memory* memory, const int index)
+{
+	const int page = index / CHIP8_MEMORY_PAGE_SIZE;
+	if (memory->written_pages & (1ULL << page))
+	{
+		struct chip8_instruction* instruction = chip8_decode_cache_private_entry(cache, memory->page_slots[page], index);
+		if (instruction->operation == CHIP8_OP_NONE)
+		{
+			*instruction = chip8_decode(chip8_memory_get_short(memory, index));
+		}
+		return instruction;
+	}
+
+	const struct chip8_instruction* instruction = &memory->image->decoded[index];
+	if (instruction->operation != CHIP8_OP_NONE && index % CHIP8_MEMORY_PAGE_SIZE != CHIP8_MEMORY_PAGE_SIZE - 1)
+	{
+		return instruction;
+	}
+
+	cache->uncached = chip8_decode(chip8_memory_get_short(memory, index));
+	return &cache->uncached;
+}
+
+const struct chip8_instruction* chip8_decode_cache_fetch(struct chip8_decode_cache* cache, const struct chip8_memory* memory, const int index)
+{
+	assert(index >= 0 && index < CHIP8_MEMORY_SIZE);
+	const struct chip8_instruction* instruction = &memory->image->decoded[index];
+	// neither the page nor the next one, where the last instruction of the page ends, was written
+	if ((memory->written_pages & (3ULL << (index / CHIP8_MEMORY_PAGE_SIZE))) == 0 && instruction->operation != CHIP8_OP_NONE)
+	{
+		return instruction;
+	}
+
+	return chip8_decode_cache_fetch_written(cache, memory, index);
+}
+
+void chip8_decode_cache_invalidate(struct chip8_decode_cache* cache, const struct chip8_memory* memory, const int index)
+{
+	assert(index >= 0 && index < CHIP8_MEMORY_SIZE);
+
+	// instructions are 2 bytes long, so the byte also belongs to the instruction starting right before it
+	for (int address = index > 0 ? index - 1 : index; address <= index; address++)
+	{
+		const int page = address / CHIP8_MEMORY_PAGE_SIZE;
+		// entries of pages the instance didn't write are in the image, and not yet decoded ones have nothing to drop
+		if ((memory->written_pages & (1ULL << page)) && memory->page_slots[page] < cache->total_private_pages)
+		{
+			cache->private_entries[memory->page_slots[page]][address % CHIP8_MEMORY_PAGE_SIZE].operation = CHIP8_OP_NONE;
+		}
+	}
+}
+
+void chip8_decode_cache_clear(struct chip8_decode_cache* cache)
+{
+	if (cache->total_private_pages > 0)
+	{
+		memset(cache->private_entries, 0, (size_t)cache->total_private_pages * sizeof(*cache->private_entries));
+	}
+}
+
+void chip8_decode_cache_free(struct chip8_decode_cache* cache)
+{
+	free(cache->private_entries);
+	cache->private_entries = NULL;
+	cache->total_private_pages = 0;
+}
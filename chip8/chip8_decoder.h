@@ -0,0 +1,100 @@
+#ifndef CHIP8_DECODER_H
+#define CHIP8_DECODER_H
+
+#include "config.h"
+
+/*
+	Decoding an opcode means working out which of the 36 instructions it is and
+	extracting its operands (nnn, kk, n, x and y). The result is cached with one entry
+	per address, so instructions that are executed over and over again (game loops)
+	are only decoded once.
+
+	The entries for the shared image are decoded by chip8_image_init and kept in the
+	image, for every instance running it. An instance only caches entries of its own
+	for the pages it wrote, and they must be invalidated whenever the memory they were
+	decoded from is written, otherwise self-modifying programs would keep executing
+	the old instruction.
+ */
+
+enum chip8_operation
+{
+	// The cache entry has not been decoded yet
+	CHIP8_OP_NONE = 0,
+	CHIP8_OP_CLS,
+	CHIP8_OP_RET,
+	CHIP8_OP_JP_ADDR,
+	CHIP8_OP_CALL_ADDR,
+	CHIP8_OP_SE_VX_BYTE,
+	CHIP8_OP_SNE_VX_BYTE,
+	CHIP8_OP_SE_VX_VY,
+	CHIP8_OP_LD_VX_BYTE,
+	CHIP8_OP_ADD_VX_BYTE,
+	CHIP8_OP_LD_VX_VY,
+	CHIP8_OP_OR_VX_VY,
+	CHIP8_OP_AND_VX_VY,
+	CHIP8_OP_XOR_VX_VY,
+	CHIP8_OP_ADD_VX_VY,
+	CHIP8_OP_SUB_VX_VY,
+	CHIP8_OP_SHR_VX,
+	CHIP8_OP_SUBN_VX_VY,
+	CHIP8_OP_SHL_VX,
+	CHIP8_OP_SNE_VX_VY,
+	CHIP8_OP_LD_I_ADDR,
+	CHIP8_OP_JP_V0_ADDR,
+	CHIP8_OP_RND_VX_BYTE,
+	CHIP8_OP_DRW_VX_VY_NIBBLE,
+	CHIP8_OP_SKP_VX,
+	CHIP8_OP_SKNP_VX,
+	CHIP8_OP_LD_VX_DT,
+	CHIP8_OP_LD_VX_K,
+	CHIP8_OP_LD_DT_VX,
+	CHIP8_OP_LD_ST_VX,
+	CHIP8_OP_ADD_I_VX,
+	CHIP8_OP_LD_F_VX,
+	CHIP8_OP_LD_B_VX,
+	CHIP8_OP_LD_I_VX,
+	CHIP8_OP_LD_VX_I,
+	// Superinstructions, only produced when translating basic blocks (see chip8_block.h)
+	// Annn; Dxyn
+	CHIP8_OP_LD_I_DRW,
+	// Fx07; 3x00; 1nnn - the classic loop waiting for the delay timer to run out
+	CHIP8_OP_WAIT_DT,
+	// Opcodes that are not supported (0nnn - SYS addr, and invalid encodings)
+	CHIP8_OP_UNKNOWN,
+	CHIP8_TOTAL_OPERATIONS
+};
+
+struct chip8_instruction
+{
+	// enum chip8_operation
+	unsigned char operation;
+	unsigned char x;
+	unsigned char y;
+	unsigned char n;
+	unsigned char kk;
+	// Number of guest instructions this instruction stands for, more than one for superinstructions
+	unsigned char length;
+	unsigned short nnn;
+};
+
+struct chip8_memory;
+
+struct chip8_decode_cache
+{
+	// Entries of the private page in slot s of the memory (see struct chip8_memory): private_entries[s]
+	struct chip8_instruction (*private_entries)[CHIP8_MEMORY_PAGE_SIZE];
+	int total_private_pages;
+	// Decoded on every fetch: instructions the image has no entry for, or ending on a page only this instance wrote
+	struct chip8_instruction uncached;
+};
+
+struct chip8_instruction chip8_decode(unsigned short opcode);
+// The entry is valid until the next fetch or invalidation
+const struct chip8_instruction* chip8_decode_cache_fetch(struct chip8_decode_cache* cache, const struct chip8_memory* memory, int index);
+// Called after the byte at index was written to memory
+void chip8_decode_cache_invalidate(struct chip8_decode_cache* cache, const struct chip8_memory* memory, int index);
+// Drops every private entry, for when the memory is mapped again
+void chip8_decode_cache_clear(struct chip8_decode_cache* cache);
+void chip8_decode_cache_free(struct chip8_decode_cache* cache);
+
+#endif
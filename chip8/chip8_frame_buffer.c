@@ -0,0 +1,33 @@
+#include "chip8_frame_buffer.h"
+#include <string.h>
+#include "chip8_platform.h"
+
+void chip8_frame_buffer_init(struct chip8_frame_buffer* frames)
+{
+	memset(frames, 0, sizeof(struct chip8_frame_buffer));
+	frames->middle = 1;
+	frames->back = 0;
+	frames->front = 2;
+}
+
+void chip8_frame_buffer_publish(struct chip8_frame_buffer* frames, const struct chip8_screen* screen, const unsigned int dirty_rows)
+{
+	struct chip8_screen* published = &frames->screens[frames->back];
+	memcpy(published->pixels, screen->pixels, sizeof(published->pixels));
+	published->dirty_rows = dirty_rows | frames->carried_rows;
+	const int middle = chip8_platform_atomic_exchange(&frames->middle, frames->back | CHIP8_FRAME_BUFFER_FRESH);
+	frames->back = middle & ~CHIP8_FRAME_BUFFER_FRESH;
+	// Kept cumulative until a take is seen: a screen replaced before being taken passes its rows on
+	frames->carried_rows = (middle & CHIP8_FRAME_BUFFER_FRESH) ? published->dirty_rows : dirty_rows;
+}
+
+const struct chip8_screen* chip8_frame_buffer_take(struct chip8_frame_buffer* frames)
+{
+	if ((chip8_platform_atomic_load(&frames->middle) & CHIP8_FRAME_BUFFER_FRESH) == 0)
+	{
+		return NULL;
+	}
+
+	frames->front = chip8_platform_atomic_exchange(&frames->middle, frames->front) & ~CHIP8_FRAME_BUFFER_FRESH;
+	return &frames->screens[frames->front];
+}
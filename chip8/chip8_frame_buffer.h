@@ -0,0 +1,37 @@
+#ifndef CHIP8_FRAME_BUFFER_H
+#define CHIP8_FRAME_BUFFER_H
+
+#include "chip8_screen.h"
+
+/*
+	Completed screens travel from the emulation thread to the presenting thread through
+	a triple buffer: the emulation thread always has a buffer of its own to draw into and
+	the presenting thread always has the latest complete screen, and neither ever waits
+	for the other. The third buffer is swapped between them atomically, with a flag
+	telling whether it holds a screen not taken yet.
+
+	The dirty_rows of a taken screen are the rows changed since the screen taken before
+	it, however many screens were published in between.
+ */
+#define CHIP8_FRAME_BUFFER_FRESH 4
+
+struct chip8_frame_buffer
+{
+	struct chip8_screen screens[3];
+	// Index of the buffer in the middle, | CHIP8_FRAME_BUFFER_FRESH when it was published since last taken
+	volatile int middle;
+	// Only used by the publishing thread
+	int back;
+	// The rows of the screens published since the last one taken
+	unsigned int carried_rows;
+	// Only used by the taking thread
+	int front;
+};
+
+void chip8_frame_buffer_init(struct chip8_frame_buffer* frames);
+// Publishes a copy of the screen, with the rows changed since the previous publish
+void chip8_frame_buffer_publish(struct chip8_frame_buffer* frames, const struct chip8_screen* screen, unsigned int dirty_rows);
+// Returns the latest screen, or NULL when none was published since last time
+const struct chip8_screen* chip8_frame_buffer_take(struct chip8_frame_buffer* frames);
+
+#endif
@@ -0,0 +1,208 @@
+#include "chip8_input_log.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHIP8_INPUT_LOG_KEY_DOWN 0x10
+#define CHIP8_INPUT_LOG_END 0x80
+
+static bool chip8_input_reserve(struct chip8_input_recorder* recorder, const size_t size)
+{
+	if (recorder->size + size <= recorder->capacity)
+	{
+		return true;
+	}
+
+	const size_t capacity = (recorder->capacity + size) * 2;
+	unsigned char* data = realloc(recorder->data, capacity);
+	if (data == NULL)
+	{
+		return false;
+	}
+	recorder->data = data;
+	recorder->capacity = capacity;
+	return true;
+}
+
+static void chip8_input_put_le(struct chip8_input_recorder* recorder, unsigned long long value, const int bytes)
+{
+	for (int i = 0; i < bytes; i++, value >>= 8)
+	{
+		recorder->data[recorder->size++] = (unsigned char)value;
+	}
+}
+
+static void chip8_input_put_leb128(struct chip8_input_recorder* recorder, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		recorder->data[recorder->size++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	recorder->data[recorder->size++] = (unsigned char)value;
+}
+
+bool chip8_input_recorder_start(struct chip8_input_recorder* recorder, const struct chip8* chip8, const unsigned long long seed, const int instructions_per_frame)
+{
+	memset(recorder, 0, sizeof(struct chip8_input_recorder));
+	// a truncated value would replay at another rate
+	if (instructions_per_frame <= 0 || instructions_per_frame > CHIP8_INPUT_LOG_MAX_INSTRUCTIONS_PER_FRAME)
+	{
+		return false;
+	}
+	if (!chip8_input_reserve(recorder, CHIP8_INPUT_LOG_HEADER_SIZE))
+	{
+		return false;
+	}
+
+	chip8_input_put_le(recorder, CHIP8_INPUT_LOG_MAGIC, 4);
+	chip8_input_put_le(recorder, CHIP8_INPUT_LOG_VERSION, 2);
+	chip8_input_put_le(recorder, (unsigned long long)instructions_per_frame, 2);
+	chip8_input_put_le(recorder, seed, 8);
+	chip8_input_put_le(recorder, chip8->memory.image->hash, 8);
+	return true;
+}
+
+static bool chip8_input_put_event(struct chip8_input_recorder* recorder, const unsigned long long frame, const int instruction, const unsigned char flags)
+{
+	assert(frame >= recorder->last_frame && instruction >= 0);
+	// two LEB128 values of up to 10 bytes and the flags
+	if (!chip8_input_reserve(recorder, 21))
+	{
+		return false;
+	}
+
+	chip8_input_put_leb128(recorder, frame - recorder->last_frame);
+	chip8_input_put_leb128(recorder, (unsigned long long)instruction);
+	recorder->data[recorder->size++] = flags;
+	recorder->last_frame = frame;
+	return true;
+}
+
+bool chip8_input_record(struct chip8_input_recorder* recorder, const unsigned long long frame, const int instruction, const int key, const bool down)
+{
+	assert(key >= 0 && key < CHIP_TOTAL_KEYS);
+	return chip8_input_put_event(recorder, frame, instruction, (unsigned char)(key | (down ? CHIP8_INPUT_LOG_KEY_DOWN : 0)));
+}
+
+bool chip8_input_recorder_finish(struct chip8_input_recorder* recorder, const unsigned long long frames)
+{
+	return chip8_input_put_event(recorder, frames, 0, CHIP8_INPUT_LOG_END);
+}
+
+void chip8_input_recorder_free(struct chip8_input_recorder* recorder)
+{
+	free(recorder->data);
+	memset(recorder, 0, sizeof(struct chip8_input_recorder));
+}
+
+static unsigned long long chip8_input_get_le(const unsigned char* data, const int bytes)
+{
+	unsigned long long value = 0;
+	for (int i = bytes - 1; i >= 0; i--)
+	{
+		value = value << 8 | data[i];
+	}
+	return value;
+}
+
+static bool chip8_input_get_leb128(struct chip8_input_replay* replay, unsigned long long* value)
+{
+	*value = 0;
+	for (int shift = 0; shift < 64 && replay->position < replay->size; shift += 7)
+	{
+		const unsigned char byte = replay->data[replay->position++];
+		*value |= (unsigned long long)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Reads the next event, has_next is false at the end of the session or of the data
+static void chip8_input_replay_advance(struct chip8_input_replay* replay)
+{
+	unsigned long long frames;
+	unsigned long long instruction;
+	replay->has_next = false;
+	if (!chip8_input_get_leb128(replay, &frames) || !chip8_input_get_leb128(replay, &instruction) || replay->position >= replay->size)
+	{
+		return;
+	}
+
+	const unsigned char flags = replay->data[replay->position++];
+	replay->next_frame += frames;
+	if (flags & CHIP8_INPUT_LOG_END)
+	{
+		replay->frames = replay->next_frame;
+		return;
+	}
+
+	replay->next_instruction = instruction > (unsigned long long)replay->instructions_per_frame ? replay->instructions_per_frame : (int)instruction;
+	replay->next_key = flags & 0x0F;
+	replay->next_down = (flags & CHIP8_INPUT_LOG_KEY_DOWN) != 0;
+	replay->has_next = true;
+	if (replay->next_frame >= replay->frames)
+	{
+		replay->frames = replay->next_frame + 1;
+	}
+}
+
+static void chip8_input_replay_rewind(struct chip8_input_replay* replay)
+{
+	replay->position = CHIP8_INPUT_LOG_HEADER_SIZE;
+	replay->next_frame = 0;
+	chip8_input_replay_advance(replay);
+}
+
+bool chip8_input_replay_open(struct chip8_input_replay* replay, const void* data, const size_t size)
+{
+	memset(replay, 0, sizeof(struct chip8_input_replay));
+	const unsigned char* bytes = data;
+	if (size < CHIP8_INPUT_LOG_HEADER_SIZE || chip8_input_get_le(bytes, 4) != CHIP8_INPUT_LOG_MAGIC
+		|| chip8_input_get_le(bytes + 4, 2) != CHIP8_INPUT_LOG_VERSION || chip8_input_get_le(bytes + 6, 2) == 0)
+	{
+		return false;
+	}
+
+	replay->data = bytes;
+	replay->size = size;
+	replay->instructions_per_frame = (int)chip8_input_get_le(bytes + 6, 2);
+	replay->seed = chip8_input_get_le(bytes + 8, 8);
+	replay->image_hash = chip8_input_get_le(bytes + 16, 8);
+
+	// One pass over the events to find out how long the session was
+	for (chip8_input_replay_rewind(replay); replay->has_next; chip8_input_replay_advance(replay))
+	{
+	}
+	chip8_input_replay_rewind(replay);
+	return true;
+}
+
+void chip8_input_replay_run_frame(struct chip8_input_replay* replay, struct chip8* chip8, const unsigned long long frame)
+{
+	int executed = 0;
+	while (replay->has_next && replay->next_frame <= frame)
+	{
+		const int instruction = replay->next_frame == frame ? replay->next_instruction : 0;
+		if (instruction > executed)
+		{
+			chip8_run(chip8, instruction - executed);
+			executed = instruction;
+		}
+
+		if (replay->next_down)
+		{
+			chip8_keyboard_down(&chip8->keyboard, replay->next_key);
+		}
+		else
+		{
+			chip8_keyboard_up(&chip8->keyboard, replay->next_key);
+		}
+		chip8_input_replay_advance(replay);
+	}
+
+	chip8_run(chip8, replay->instructions_per_frame - executed);
+}
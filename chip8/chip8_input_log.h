@@ -0,0 +1,73 @@
+#ifndef CHIP8_INPUT_LOG_H
+#define CHIP8_INPUT_LOG_H
+
+#include "chip8.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+	Input logs: every key transition of a session, so the session can be replayed
+	bit-exactly (given the same ROM, seed and instructions per frame, which the log
+	records in its header).
+
+	The log is a 24-byte header followed by one event per transition:
+	- the number of frames since the previous event, LEB128
+	- the instruction within the frame the event happened before, LEB128
+	- the key in the low nibble, 0x10 when it went down, 0x80 for the end of the session
+	so an event usually takes 3 bytes. Values in the header are little-endian.
+ */
+
+#define CHIP8_INPUT_LOG_MAGIC 0x49384843u
+#define CHIP8_INPUT_LOG_VERSION 1
+#define CHIP8_INPUT_LOG_HEADER_SIZE 24
+// The header stores the instructions per frame in 2 bytes
+#define CHIP8_INPUT_LOG_MAX_INSTRUCTIONS_PER_FRAME 0xFFFF
+
+struct chip8_input_recorder
+{
+	// Encoded log the caller hasn't written out yet. Write data[0..size) whenever convenient
+	// (a log can be streamed to a file as the session goes) and set size back to 0.
+	unsigned char* data;
+	size_t size;
+	size_t capacity;
+	unsigned long long last_frame;
+};
+
+struct chip8_input_replay
+{
+	const unsigned char* data;
+	size_t size;
+	size_t position;
+	// From the header
+	unsigned long long seed;
+	int instructions_per_frame;
+	unsigned long long image_hash;
+	// Length of the session, up to the last event when the log ends without an end marker
+	unsigned long long frames;
+	// The next event, while there is one
+	bool has_next;
+	unsigned long long next_frame;
+	int next_instruction;
+	unsigned char next_key;
+	bool next_down;
+};
+
+/*
+	The seed must be the one the instance was seeded with. All of these return false when out of memory,
+	and chip8_input_recorder_start also when instructions_per_frame isn't within 1..CHIP8_INPUT_LOG_MAX_INSTRUCTIONS_PER_FRAME.
+ */
+bool chip8_input_recorder_start(struct chip8_input_recorder* recorder, const struct chip8* chip8, unsigned long long seed, int instructions_per_frame);
+bool chip8_input_record(struct chip8_input_recorder* recorder, unsigned long long frame, int instruction, int key, bool down);
+// Marks the end of the session, after the given number of frames
+bool chip8_input_recorder_finish(struct chip8_input_recorder* recorder, unsigned long long frames);
+void chip8_input_recorder_free(struct chip8_input_recorder* recorder);
+
+// The data must outlive the replay. Returns false when it isn't an input log.
+bool chip8_input_replay_open(struct chip8_input_replay* replay, const void* data, size_t size);
+/*
+	Runs the given frame (without ticking the timers), pressing and releasing keys at the
+	instructions they were recorded at. Frames must be run in order, starting at 0.
+ */
+void chip8_input_replay_run_frame(struct chip8_input_replay* replay, struct chip8* chip8, unsigned long long frame);
+
+#endif
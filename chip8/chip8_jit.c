@@ -0,0 +1,648 @@
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#endif
+#include "chip8_jit.h"
+#include "chip8.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_SUPPORTED
+#endif
+
+#ifdef CHIP8_JIT_SUPPORTED
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+enum chip8_jit_entry_state
+{
+	CHIP8_JIT_NOT_COMPILED = 0,
+	CHIP8_JIT_COMPILED,
+	// The first instruction has no native translation, always use the interpreter
+	CHIP8_JIT_UNSUPPORTED
+};
+
+struct chip8_jit_entry
+{
+	struct chip8_jit_block block;
+	unsigned char state;
+};
+
+struct chip8_jit
+{
+	unsigned char* code;
+	size_t code_used;
+	// One bit per CHIP8_BLOCK_REGION_SIZE bytes of guest memory that has been compiled
+	unsigned long long code_regions;
+	struct chip8_jit_entry entries[CHIP8_MEMORY_SIZE];
+};
+
+#ifdef CHIP8_JIT_SUPPORTED
+
+// x86-64 register numbers, as used in the ModRM and REX encodings
+enum chip8_jit_register
+{
+	RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Host registers the guest V registers are allocated to. RBX holds the struct chip8 pointer
+// and RAX/RCX are scratch registers.
+static const unsigned char chip8_jit_register_pool[] = { RSI, RDI, R8, R9, R10, R11, RBP, R12, R13, R14, R15 };
+#define CHIP8_JIT_POOL_SIZE (sizeof(chip8_jit_register_pool) / sizeof(chip8_jit_register_pool[0]))
+
+// Saved on entry and restored on exit, this covers the callee-saved registers of both the
+// System V and the Windows x64 calling conventions
+static const unsigned char chip8_jit_saved_registers[] = { RBX, RBP, RSI, RDI, R12, R13, R14, R15 };
+#define CHIP8_JIT_SAVED_COUNT (sizeof(chip8_jit_saved_registers) / sizeof(chip8_jit_saved_registers[0]))
+
+#define CHIP8_JIT_OFFSET_V(x) ((int)(offsetof(struct chip8, registers.V) + (x)))
+#define CHIP8_JIT_OFFSET_I ((int)offsetof(struct chip8, registers.I))
+#define CHIP8_JIT_OFFSET_PC ((int)offsetof(struct chip8, registers.PC))
+#define CHIP8_JIT_OFFSET_DT ((int)offsetof(struct chip8, registers.delay_timer))
+#define CHIP8_JIT_OFFSET_ST ((int)offsetof(struct chip8, registers.sound_timer))
+
+struct chip8_jit_emitter
+{
+	unsigned char* code;
+	size_t used;
+	size_t size;
+	bool overflow;
+};
+
+static void chip8_jit_emit(struct chip8_jit_emitter* emitter, const unsigned char byte)
+{
+	if (emitter->used >= emitter->size)
+	{
+		emitter->overflow = true;
+		return;
+	}
+
+	emitter->code[emitter->used++] = byte;
+}
+
+static void chip8_jit_emit16(struct chip8_jit_emitter* emitter, const unsigned short value)
+{
+	chip8_jit_emit(emitter, value & 0xFF);
+	chip8_jit_emit(emitter, value >> 8 & 0xFF);
+}
+
+static void chip8_jit_emit32(struct chip8_jit_emitter* emitter, const int value)
+{
+	const unsigned int bits = (unsigned int)value;
+	for (int i = 0; i < 4; i++)
+	{
+		chip8_jit_emit(emitter, bits >> (8 * i) & 0xFF);
+	}
+}
+
+// REX prefix. Always emitted for byte operations so SIL, DIL and BPL can be addressed.
+static void chip8_jit_emit_rex(struct chip8_jit_emitter* emitter, const bool wide, const int reg, const int rm)
+{
+	chip8_jit_emit(emitter, 0x40 | (wide ? 0x08 : 0) | (reg >> 3 & 1) << 2 | (rm >> 3 & 1));
+}
+
+static void chip8_jit_emit_modrm(struct chip8_jit_emitter* emitter, const int mod, const int reg, const int rm)
+{
+	chip8_jit_emit(emitter, (unsigned char)(mod << 6 | (reg & 7) << 3 | (rm & 7)));
+}
+
+// opcode r/m8, r8 with both operands in registers
+static void chip8_jit_emit_rr8(struct chip8_jit_emitter* emitter, const unsigned char opcode, const int dst, const int src)
+{
+	chip8_jit_emit_rex(emitter, false, src, dst);
+	chip8_jit_emit(emitter, opcode);
+	chip8_jit_emit_modrm(emitter, 3, src, dst);
+}
+
+// opcode with a [rbx + disp32] memory operand
+static void chip8_jit_emit_mem(struct chip8_jit_emitter* emitter, const int reg, const int offset)
+{
+	chip8_jit_emit_modrm(emitter, 2, reg, RBX);
+	chip8_jit_emit32(emitter, offset);
+}
+
+// movzx r32, byte [rbx + offset]
+static void chip8_jit_emit_load_v(struct chip8_jit_emitter* emitter, const int reg, const int offset)
+{
+	chip8_jit_emit_rex(emitter, false, reg, RBX);
+	chip8_jit_emit(emitter, 0x0F);
+	chip8_jit_emit(emitter, 0xB6);
+	chip8_jit_emit_mem(emitter, reg, offset);
+}
+
+// mov r8, byte [rbx + offset]
+static void chip8_jit_emit_load8(struct chip8_jit_emitter* emitter, const int reg, const int offset)
+{
+	chip8_jit_emit_rex(emitter, false, reg, RBX);
+	chip8_jit_emit(emitter, 0x8A);
+	chip8_jit_emit_mem(emitter, reg, offset);
+}
+
+// mov byte [rbx + offset], r8
+static void chip8_jit_emit_store8(struct chip8_jit_emitter* emitter, const int reg, const int offset)
+{
+	chip8_jit_emit_rex(emitter, false, reg, RBX);
+	chip8_jit_emit(emitter, 0x88);
+	chip8_jit_emit_mem(emitter, reg, offset);
+}
+
+// mov word [rbx + offset], imm16
+static void chip8_jit_emit_store16_imm(struct chip8_jit_emitter* emitter, const int offset, const unsigned short value)
+{
+	chip8_jit_emit(emitter, 0x66);
+	chip8_jit_emit(emitter, 0xC7);
+	chip8_jit_emit_mem(emitter, 0, offset);
+	chip8_jit_emit16(emitter, value);
+}
+
+// mov r8, imm8
+static void chip8_jit_emit_mov8_imm(struct chip8_jit_emitter* emitter, const int reg, const unsigned char value)
+{
+	chip8_jit_emit_rex(emitter, false, 0, reg);
+	chip8_jit_emit(emitter, 0xB0 + (reg & 7));
+	chip8_jit_emit(emitter, value);
+}
+
+// 0x80 /digit r/m8, imm8 (digit 0 = add, 4 = and)
+static void chip8_jit_emit_alu8_imm(struct chip8_jit_emitter* emitter, const int digit, const int reg, const unsigned char value)
+{
+	chip8_jit_emit_rex(emitter, false, 0, reg);
+	chip8_jit_emit(emitter, 0x80);
+	chip8_jit_emit_modrm(emitter, 3, digit, reg);
+	chip8_jit_emit(emitter, value);
+}
+
+// 0xD0 /digit r/m8, 1 (digit 4 = shl, 5 = shr)
+static void chip8_jit_emit_shift8(struct chip8_jit_emitter* emitter, const int digit, const int reg)
+{
+	chip8_jit_emit_rex(emitter, false, 0, reg);
+	chip8_jit_emit(emitter, 0xD0);
+	chip8_jit_emit_modrm(emitter, 3, digit, reg);
+}
+
+// setcc al
+static void chip8_jit_emit_setcc_al(struct chip8_jit_emitter* emitter, const unsigned char condition)
+{
+	chip8_jit_emit(emitter, 0x0F);
+	chip8_jit_emit(emitter, condition);
+	chip8_jit_emit_modrm(emitter, 3, 0, RAX);
+}
+
+static void chip8_jit_emit_push(struct chip8_jit_emitter* emitter, const int reg)
+{
+	if (reg >= R8)
+	{
+		chip8_jit_emit(emitter, 0x41);
+	}
+	chip8_jit_emit(emitter, 0x50 + (reg & 7));
+}
+
+static void chip8_jit_emit_pop(struct chip8_jit_emitter* emitter, const int reg)
+{
+	if (reg >= R8)
+	{
+		chip8_jit_emit(emitter, 0x41);
+	}
+	chip8_jit_emit(emitter, 0x58 + (reg & 7));
+}
+
+#define CHIP8_JIT_ADD 0x00
+#define CHIP8_JIT_OR 0x08
+#define CHIP8_JIT_AND 0x20
+#define CHIP8_JIT_SUB 0x28
+#define CHIP8_JIT_XOR 0x30
+#define CHIP8_JIT_CMP 0x38
+#define CHIP8_JIT_MOV 0x88
+#define CHIP8_JIT_SETB 0x92
+#define CHIP8_JIT_SETA 0x97
+
+static bool chip8_jit_is_supported(const struct chip8_instruction* instruction)
+{
+	switch (instruction->operation)
+	{
+		case CHIP8_OP_JP_ADDR:
+		case CHIP8_OP_LD_VX_BYTE:
+		case CHIP8_OP_ADD_VX_BYTE:
+		case CHIP8_OP_LD_VX_VY:
+		case CHIP8_OP_OR_VX_VY:
+		case CHIP8_OP_AND_VX_VY:
+		case CHIP8_OP_XOR_VX_VY:
+		case CHIP8_OP_ADD_VX_VY:
+		case CHIP8_OP_SUB_VX_VY:
+		case CHIP8_OP_SHR_VX:
+		case CHIP8_OP_SUBN_VX_VY:
+		case CHIP8_OP_SHL_VX:
+		case CHIP8_OP_LD_I_ADDR:
+		case CHIP8_OP_LD_VX_DT:
+		case CHIP8_OP_LD_DT_VX:
+		case CHIP8_OP_LD_ST_VX:
+		case CHIP8_OP_ADD_I_VX:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Marks the V registers an instruction reads or writes
+static void chip8_jit_mark_registers(const struct chip8_instruction* instruction, bool used[CHIP8_TOTAL_DATA_REGISTERS])
+{
+	switch (instruction->operation)
+	{
+		case CHIP8_OP_JP_ADDR:
+		case CHIP8_OP_LD_I_ADDR:
+			break;
+
+		case CHIP8_OP_LD_VX_VY:
+		case CHIP8_OP_OR_VX_VY:
+		case CHIP8_OP_AND_VX_VY:
+		case CHIP8_OP_XOR_VX_VY:
+			used[instruction->x] = true;
+			used[instruction->y] = true;
+			break;
+
+		case CHIP8_OP_ADD_VX_VY:
+		case CHIP8_OP_SUB_VX_VY:
+		case CHIP8_OP_SUBN_VX_VY:
+			used[instruction->x] = true;
+			used[instruction->y] = true;
+			used[0x0F] = true;
+			break;
+
+		case CHIP8_OP_SHR_VX:
+		case CHIP8_OP_SHL_VX:
+			used[instruction->x] = true;
+			used[0x0F] = true;
+			break;
+
+		default:
+			used[instruction->x] = true;
+			break;
+	}
+}
+
+static int chip8_jit_count_registers(const bool used[CHIP8_TOTAL_DATA_REGISTERS])
+{
+	int count = 0;
+	for (int i = 0; i < CHIP8_TOTAL_DATA_REGISTERS; i++)
+	{
+		count += used[i];
+	}
+	return count;
+}
+
+static void chip8_jit_emit_instruction(struct chip8_jit_emitter* emitter, const struct chip8_instruction* instruction, const unsigned char host[CHIP8_TOTAL_DATA_REGISTERS])
+{
+	const int vx = host[instruction->x];
+	const int vy = host[instruction->y];
+	const int vf = host[0x0F];
+
+	switch (instruction->operation)
+	{
+		case CHIP8_OP_LD_VX_BYTE:
+			chip8_jit_emit_mov8_imm(emitter, vx, instruction->kk);
+			break;
+
+		case CHIP8_OP_ADD_VX_BYTE:
+			chip8_jit_emit_alu8_imm(emitter, 0, vx, instruction->kk);
+			break;
+
+		case CHIP8_OP_LD_VX_VY:
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, vx, vy);
+			break;
+
+		case CHIP8_OP_OR_VX_VY:
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_OR, vx, vy);
+			break;
+
+		case CHIP8_OP_AND_VX_VY:
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_AND, vx, vy);
+			break;
+
+		case CHIP8_OP_XOR_VX_VY:
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_XOR, vx, vy);
+			break;
+
+		case CHIP8_OP_ADD_VX_VY:
+			// Vx += Vy, then VF = carry
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_ADD, vx, vy);
+			chip8_jit_emit_setcc_al(emitter, CHIP8_JIT_SETB);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, vf, RAX);
+			break;
+
+		case CHIP8_OP_SUB_VX_VY:
+			// VF = Vx > Vy, then Vx -= Vy
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_CMP, vx, vy);
+			chip8_jit_emit_setcc_al(emitter, CHIP8_JIT_SETA);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, vf, RAX);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_SUB, vx, vy);
+			break;
+
+		case CHIP8_OP_SUBN_VX_VY:
+			// VF = Vx < Vy, then Vx = Vy - Vx
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_CMP, vx, vy);
+			chip8_jit_emit_setcc_al(emitter, CHIP8_JIT_SETB);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, vf, RAX);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, RCX, vy);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_SUB, RCX, vx);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, vx, RCX);
+			break;
+
+		case CHIP8_OP_SHR_VX:
+			// VF = Vx & 1, then Vx >>= 1
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, RAX, vx);
+			chip8_jit_emit_alu8_imm(emitter, 4, RAX, 0x01);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, vf, RAX);
+			chip8_jit_emit_shift8(emitter, 5, vx);
+			break;
+
+		case CHIP8_OP_SHL_VX:
+			// VF = 0, VF = Vx >> 7, then Vx <<= 1 - like the interpreter, 8FxE always leaves VF = 0
+			chip8_jit_emit_mov8_imm(emitter, vf, 0);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, RAX, vx);
+			chip8_jit_emit_rex(emitter, false, 0, RAX);
+			chip8_jit_emit(emitter, 0xC0);
+			chip8_jit_emit_modrm(emitter, 3, 5, RAX);
+			chip8_jit_emit(emitter, 7);
+			chip8_jit_emit_rr8(emitter, CHIP8_JIT_MOV, vf, RAX);
+			chip8_jit_emit_shift8(emitter, 4, vx);
+			break;
+
+		case CHIP8_OP_LD_I_ADDR:
+			chip8_jit_emit_store16_imm(emitter, CHIP8_JIT_OFFSET_I, instruction->nnn);
+			break;
+
+		case CHIP8_OP_ADD_I_VX:
+			// movzx eax, Vx; add word [I], ax
+			chip8_jit_emit_rex(emitter, false, RAX, vx);
+			chip8_jit_emit(emitter, 0x0F);
+			chip8_jit_emit(emitter, 0xB6);
+			chip8_jit_emit_modrm(emitter, 3, RAX, vx);
+			chip8_jit_emit(emitter, 0x66);
+			chip8_jit_emit(emitter, 0x01);
+			chip8_jit_emit_mem(emitter, RAX, CHIP8_JIT_OFFSET_I);
+			break;
+
+		case CHIP8_OP_LD_VX_DT:
+			chip8_jit_emit_load8(emitter, vx, CHIP8_JIT_OFFSET_DT);
+			break;
+
+		case CHIP8_OP_LD_DT_VX:
+			chip8_jit_emit_store8(emitter, vx, CHIP8_JIT_OFFSET_DT);
+			break;
+
+		case CHIP8_OP_LD_ST_VX:
+			chip8_jit_emit_store8(emitter, vx, CHIP8_JIT_OFFSET_ST);
+			break;
+
+		default:
+			// CHIP8_OP_JP_ADDR only changes PC, which is written when leaving the block
+			break;
+	}
+}
+
+/*
+	The code buffer is never writable and executable at the same time, hardened kernels and
+	SELinux policies refuse such mappings. It is mapped read-write here, and switched to
+	read-execute by chip8_jit_protect_code whenever no block is being emitted.
+ */
+static void* chip8_jit_alloc_code(const size_t size)
+{
+#ifdef _WIN32
+	return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void* code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return code == MAP_FAILED ? NULL : code;
+#endif
+}
+
+static bool chip8_jit_protect_code(void* code, const size_t size, const bool writable)
+{
+#ifdef _WIN32
+	DWORD previous;
+	if (!VirtualProtect(code, size, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &previous))
+	{
+		return false;
+	}
+	return writable || FlushInstructionCache(GetCurrentProcess(), code, size);
+#else
+	return mprotect(code, size, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+static void chip8_jit_free_code(void* code, const size_t size)
+{
+#ifdef _WIN32
+	VirtualFree(code, 0, MEM_RELEASE);
+#else
+	munmap(code, size);
+#endif
+}
+
+static bool chip8_jit_compile(struct chip8_jit* jit, struct chip8* chip8, const int index, struct chip8_jit_entry* entry)
+{
+	struct chip8_instruction instructions[CHIP8_BLOCK_MAX_INSTRUCTIONS];
+	bool used[CHIP8_TOTAL_DATA_REGISTERS] = { false };
+	int count = 0;
+	int address = index;
+
+	while (count < CHIP8_BLOCK_MAX_INSTRUCTIONS && address + 1 < CHIP8_MEMORY_SIZE)
+	{
+		const struct chip8_instruction* instruction = chip8_decode_cache_fetch(&chip8->decode_cache, &chip8->memory, address);
+		if (!chip8_jit_is_supported(instruction))
+		{
+			break;
+		}
+
+		bool needed[CHIP8_TOTAL_DATA_REGISTERS];
+		memcpy(needed, used, sizeof(needed));
+		chip8_jit_mark_registers(instruction, needed);
+		if (chip8_jit_count_registers(needed) > (int)CHIP8_JIT_POOL_SIZE)
+		{
+			break;
+		}
+
+		memcpy(used, needed, sizeof(used));
+		instructions[count++] = *instruction;
+		address += 2;
+
+		if (instruction->operation == CHIP8_OP_JP_ADDR)
+		{
+			break;
+		}
+	}
+
+	if (count == 0)
+	{
+		entry->state = CHIP8_JIT_UNSUPPORTED;
+		return true;
+	}
+
+	unsigned char host[CHIP8_TOTAL_DATA_REGISTERS] = { 0 };
+	int allocated = 0;
+	for (int i = 0; i < CHIP8_TOTAL_DATA_REGISTERS; i++)
+	{
+		if (used[i])
+		{
+			host[i] = chip8_jit_register_pool[allocated++];
+		}
+	}
+
+	if (!chip8_jit_protect_code(jit->code, CHIP8_JIT_CODE_SIZE, true))
+	{
+		return false;
+	}
+
+	struct chip8_jit_emitter emitter;
+	emitter.code = jit->code + jit->code_used;
+	emitter.used = 0;
+	emitter.size = CHIP8_JIT_CODE_SIZE - jit->code_used;
+	emitter.overflow = false;
+
+	// prologue
+	for (size_t i = 0; i < CHIP8_JIT_SAVED_COUNT; i++)
+	{
+		chip8_jit_emit_push(&emitter, chip8_jit_saved_registers[i]);
+	}
+#ifdef _WIN32
+	chip8_jit_emit_rex(&emitter, true, RCX, RBX);
+	chip8_jit_emit(&emitter, 0x89);
+	chip8_jit_emit_modrm(&emitter, 3, RCX, RBX);
+#else
+	chip8_jit_emit_rex(&emitter, true, RDI, RBX);
+	chip8_jit_emit(&emitter, 0x89);
+	chip8_jit_emit_modrm(&emitter, 3, RDI, RBX);
+#endif
+	for (int i = 0; i < CHIP8_TOTAL_DATA_REGISTERS; i++)
+	{
+		if (used[i])
+		{
+			chip8_jit_emit_load_v(&emitter, host[i], CHIP8_JIT_OFFSET_V(i));
+		}
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		chip8_jit_emit_instruction(&emitter, &instructions[i], host);
+	}
+
+	// epilogue
+	for (int i = 0; i < CHIP8_TOTAL_DATA_REGISTERS; i++)
+	{
+		if (used[i])
+		{
+			chip8_jit_emit_store8(&emitter, host[i], CHIP8_JIT_OFFSET_V(i));
+		}
+	}
+	const struct chip8_instruction* last = &instructions[count - 1];
+	chip8_jit_emit_store16_imm(&emitter, CHIP8_JIT_OFFSET_PC, last->operation == CHIP8_OP_JP_ADDR ? last->nnn : (unsigned short)address);
+	for (size_t i = CHIP8_JIT_SAVED_COUNT; i > 0; i--)
+	{
+		chip8_jit_emit_pop(&emitter, chip8_jit_saved_registers[i - 1]);
+	}
+	chip8_jit_emit(&emitter, 0xC3);
+
+	if (!chip8_jit_protect_code(jit->code, CHIP8_JIT_CODE_SIZE, false) || emitter.overflow)
+	{
+		return false;
+	}
+
+	entry->block.function = (chip8_jit_function)(void*)emitter.code;
+	entry->block.instructions = (unsigned char)count;
+	entry->state = CHIP8_JIT_COMPILED;
+	jit->code_used += emitter.used;
+
+	for (int region = index / CHIP8_BLOCK_REGION_SIZE; region <= (address - 1) / CHIP8_BLOCK_REGION_SIZE; region++)
+	{
+		jit->code_regions |= 1ULL << region;
+	}
+
+	return true;
+}
+
+#endif
+
+struct chip8_jit* chip8_jit_create(void)
+{
+#ifdef CHIP8_JIT_SUPPORTED
+	struct chip8_jit* jit = calloc(1, sizeof(struct chip8_jit));
+	if (jit == NULL)
+	{
+		return NULL;
+	}
+
+	jit->code = chip8_jit_alloc_code(CHIP8_JIT_CODE_SIZE);
+	if (jit->code == NULL)
+	{
+		free(jit);
+		return NULL;
+	}
+	// finds out right away whether the host lets the buffer become executable at all
+	if (!chip8_jit_protect_code(jit->code, CHIP8_JIT_CODE_SIZE, false))
+	{
+		chip8_jit_free_code(jit->code, CHIP8_JIT_CODE_SIZE);
+		free(jit);
+		return NULL;
+	}
+
+	return jit;
+#else
+	return NULL;
+#endif
+}
+
+void chip8_jit_destroy(struct chip8_jit* jit)
+{
+	if (jit == NULL)
+	{
+		return;
+	}
+
+#ifdef CHIP8_JIT_SUPPORTED
+	chip8_jit_free_code(jit->code, CHIP8_JIT_CODE_SIZE);
+#endif
+	free(jit);
+}
+
+const struct chip8_jit_block* chip8_jit_fetch(struct chip8_jit* jit, struct chip8* chip8, const int index)
+{
+#ifdef CHIP8_JIT_SUPPORTED
+	assert(index >= 0 && index < CHIP8_MEMORY_SIZE);
+	struct chip8_jit_entry* entry = &jit->entries[index];
+	if (entry->state == CHIP8_JIT_NOT_COMPILED && !chip8_jit_compile(jit, chip8, index, entry))
+	{
+		// out of code space (or the buffer could not change protection), start over with an empty buffer
+		chip8_jit_clear(jit);
+		if (!chip8_jit_compile(jit, chip8, index, entry))
+		{
+			entry->state = CHIP8_JIT_UNSUPPORTED;
+		}
+	}
+
+	return entry->state == CHIP8_JIT_COMPILED ? &entry->block : NULL;
+#else
+	return NULL;
+#endif
+}
+
+void chip8_jit_invalidate(struct chip8_jit* jit, const int index)
+{
+	const unsigned long long regions = 1ULL << (index / CHIP8_BLOCK_REGION_SIZE) | (index > 0 ? 1ULL << ((index - 1) / CHIP8_BLOCK_REGION_SIZE) : 0);
+	if (jit->code_regions & regions)
+	{
+		chip8_jit_clear(jit);
+	}
+}
+
+void chip8_jit_clear(struct chip8_jit* jit)
+{
+	memset(jit->entries, 0, sizeof(jit->entries));
+	jit->code_regions = 0;
+	jit->code_used = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+#include <stdbool.h>
+#include "config.h"
+
+/*
+	Dynamic recompiler for x86-64 hosts.
+
+	Basic blocks are translated into native code the first time they are executed.
+	Inside a block, the V registers the block uses are kept in host registers: they
+	are loaded on entry and written back, together with PC, on exit.
+
+	Only the arithmetic, register and timer instructions are compiled. A block ends
+	right before any other instruction, and right after a 1nnn jump. Execution then
+	falls back to the interpreter for a single instruction (e.g. Dxyn, Fx0A, the skips)
+	before looking up the next compiled block, so rare instructions don't need a
+	native translation at all.
+
+	Writing to memory that holds compiled code throws away everything that was compiled,
+	which keeps self-modifying programs correct.
+
+	The native code is only ever writable or executable, not both: the buffer is made
+	writable while a block is emitted and executable again right after.
+ */
+
+struct chip8;
+struct chip8_jit;
+
+typedef void (*chip8_jit_function)(struct chip8* chip8);
+
+struct chip8_jit_block
+{
+	chip8_jit_function function;
+	// Number of guest instructions executed by the block
+	unsigned char instructions;
+};
+
+// Returns NULL when the host is not supported or executable memory can't be allocated
+struct chip8_jit* chip8_jit_create(void);
+void chip8_jit_destroy(struct chip8_jit* jit);
+// Returns NULL when the instruction at index can't be compiled
+const struct chip8_jit_block* chip8_jit_fetch(struct chip8_jit* jit, struct chip8* chip8, int index);
+void chip8_jit_invalidate(struct chip8_jit* jit, int index);
+void chip8_jit_clear(struct chip8_jit* jit);
+
+#endif
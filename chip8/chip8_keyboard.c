@@ -27,6 +27,11 @@ int chip8_keyboard_map(const struct chip8_keyboard *keyboard, const int key)
 void chip8_keyboard_down(struct chip8_keyboard *keyboard, const int key)
 {
 	chip8_keyboard_is_in_bounds(key);
+	// a key repeating while held is not a new press
+	if (keyboard->waiting && keyboard->pressed_key < 0 && !keyboard->keyboard[key])
+	{
+		keyboard->pressed_key = key;
+	}
 	keyboard->keyboard[key] = true;
 }
 
@@ -41,4 +46,21 @@ bool chip8_keyboard_is_down(const struct chip8_keyboard *keyboard, const int key
 
 	chip8_keyboard_is_in_bounds(key);
 	return keyboard->keyboard[key];
-}
\ No newline at end of file
+}
+
+void chip8_keyboard_wait(struct chip8_keyboard* keyboard)
+{
+	keyboard->waiting = true;
+	keyboard->pressed_key = -1;
+}
+
+int chip8_keyboard_take_pressed(struct chip8_keyboard* keyboard)
+{
+	const int key = keyboard->pressed_key;
+	if (key >= 0)
+	{
+		keyboard->waiting = false;
+		keyboard->pressed_key = -1;
+	}
+	return key;
+}
@@ -21,6 +21,10 @@ struct chip8_keyboard
 {
 	bool keyboard[CHIP_TOTAL_KEYS];
 	const char* keyboard_map;
+	// Set while Fx0A waits for a key press
+	bool waiting;
+	// The first key pressed while waiting, -1 until one is
+	int pressed_key;
 };
 
 void chip8_keyboard_set_map(struct chip8_keyboard* keyboard, const char* map);
@@ -28,5 +32,9 @@ int chip8_keyboard_map(const struct chip8_keyboard *keyboard, const int key);
 void chip8_keyboard_down(struct chip8_keyboard *keyboard, const int key);
 void chip8_keyboard_up(struct chip8_keyboard *keyboard, const int key);
 bool chip8_keyboard_is_down(const struct chip8_keyboard* keyboard, const int key);
+// Latches the next key that goes down, keys already down don't count
+void chip8_keyboard_wait(struct chip8_keyboard* keyboard);
+// Returns the key latched since chip8_keyboard_wait and stops waiting, or -1 while there is none
+int chip8_keyboard_take_pressed(struct chip8_keyboard* keyboard);
 
 #endif
@@ -0,0 +1,554 @@
+#include "chip8_lockstep.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_LOCKSTEP_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC accepts AVX2 intrinsics anywhere, the caller checks the CPU first
+#define CHIP8_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define CHIP8_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static struct chip8* chip8_lockstep_load_lane(struct chip8_lockstep* lockstep, const int lane)
+{
+	struct chip8* machine = &lockstep->machines[lane];
+	for (int r = 0; r < CHIP8_TOTAL_DATA_REGISTERS; r++)
+	{
+		machine->registers.V[r] = lockstep->V[r][lane];
+	}
+	machine->registers.I = lockstep->I[lane];
+	machine->registers.PC = lockstep->PC[lane];
+	machine->registers.delay_timer = lockstep->delay_timer[lane];
+	machine->registers.sound_timer = lockstep->sound_timer[lane];
+	return machine;
+}
+
+static void chip8_lockstep_store_lane(struct chip8_lockstep* lockstep, const int lane)
+{
+	const struct chip8* machine = &lockstep->machines[lane];
+	for (int r = 0; r < CHIP8_TOTAL_DATA_REGISTERS; r++)
+	{
+		lockstep->V[r][lane] = machine->registers.V[r];
+	}
+	lockstep->I[lane] = machine->registers.I;
+	lockstep->PC[lane] = machine->registers.PC;
+	lockstep->delay_timer[lane] = machine->registers.delay_timer;
+	lockstep->sound_timer[lane] = machine->registers.sound_timer;
+}
+
+#ifdef CHIP8_LOCKSTEP_AVX2
+
+static bool chip8_lockstep_host_has_avx2(void)
+{
+	// AVX2 needs both the CPU (CPUID leaf 7) and the OS saving the YMM registers (XCR0)
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0)
+	{
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_OSXSAVE) == 0)
+	{
+		return false;
+	}
+	unsigned int xcr0_low, xcr0_high;
+	__asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+	(void)xcr0_high;
+	if ((xcr0_low & 6) != 6 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+	{
+		return false;
+	}
+	return (ebx & bit_AVX2) != 0;
+#endif
+}
+
+#define CHIP8_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define CHIP8_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+
+// 1 in every byte of a where a > b (unsigned), 0 elsewhere
+CHIP8_TARGET_AVX2 static __m256i chip8_lockstep_greater_than(const __m256i a, const __m256i b)
+{
+	const __m256i not_greater = _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), b);
+	return _mm256_andnot_si256(not_greater, _mm256_set1_epi8(1));
+}
+
+/*
+	Register and timer instructions for 32 lanes at a time. The operands are reloaded after
+	every store, exactly like the interpreter reads them, so x or y being F gives the same
+	results. Returns false for the instructions it doesn't handle.
+ */
+CHIP8_TARGET_AVX2 static bool chip8_lockstep_execute_avx2(struct chip8_lockstep* lockstep, const struct chip8_instruction* instruction)
+{
+	unsigned char* x = lockstep->V[instruction->x];
+	const unsigned char* y = lockstep->V[instruction->y];
+	unsigned char* f = lockstep->V[0x0F];
+	const __m256i one = _mm256_set1_epi8(1);
+
+	switch (instruction->operation)
+	{
+		case CHIP8_OP_ADD_VX_BYTE:
+		{
+			const __m256i kk = _mm256_set1_epi8((char)instruction->kk);
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				CHIP8_STORE(x + i, _mm256_add_epi8(CHIP8_LOAD(x + i), kk));
+			}
+			return true;
+		}
+
+		case CHIP8_OP_OR_VX_VY:
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				CHIP8_STORE(x + i, _mm256_or_si256(CHIP8_LOAD(x + i), CHIP8_LOAD(y + i)));
+			}
+			return true;
+
+		case CHIP8_OP_AND_VX_VY:
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				CHIP8_STORE(x + i, _mm256_and_si256(CHIP8_LOAD(x + i), CHIP8_LOAD(y + i)));
+			}
+			return true;
+
+		case CHIP8_OP_XOR_VX_VY:
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				CHIP8_STORE(x + i, _mm256_xor_si256(CHIP8_LOAD(x + i), CHIP8_LOAD(y + i)));
+			}
+			return true;
+
+		case CHIP8_OP_ADD_VX_VY:
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				const __m256i vx = CHIP8_LOAD(x + i);
+				const __m256i vy = CHIP8_LOAD(y + i);
+				// carry when vx > 255 - vy
+				const __m256i carry = chip8_lockstep_greater_than(vx, _mm256_xor_si256(vy, _mm256_set1_epi8(-1)));
+				CHIP8_STORE(x + i, _mm256_add_epi8(vx, vy));
+				CHIP8_STORE(f + i, carry);
+			}
+			return true;
+
+		case CHIP8_OP_SUB_VX_VY:
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				CHIP8_STORE(f + i, chip8_lockstep_greater_than(CHIP8_LOAD(x + i), CHIP8_LOAD(y + i)));
+				CHIP8_STORE(x + i, _mm256_sub_epi8(CHIP8_LOAD(x + i), CHIP8_LOAD(y + i)));
+			}
+			return true;
+
+		case CHIP8_OP_SHR_VX:
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				CHIP8_STORE(f + i, _mm256_and_si256(CHIP8_LOAD(x + i), one));
+				// there is no 8-bit shift, shift 16-bit words and drop the bit coming from the neighbour
+				const __m256i shifted = _mm256_srli_epi16(CHIP8_LOAD(x + i), 1);
+				CHIP8_STORE(x + i, _mm256_and_si256(shifted, _mm256_set1_epi8(0x7F)));
+			}
+			return true;
+
+		case CHIP8_OP_SUBN_VX_VY:
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				CHIP8_STORE(f + i, chip8_lockstep_greater_than(CHIP8_LOAD(y + i), CHIP8_LOAD(x + i)));
+				CHIP8_STORE(x + i, _mm256_sub_epi8(CHIP8_LOAD(y + i), CHIP8_LOAD(x + i)));
+			}
+			return true;
+
+		case CHIP8_OP_SHL_VX:
+			for (int i = 0; i < lockstep->padded_lanes; i += 32)
+			{
+				CHIP8_STORE(f + i, _mm256_setzero_si256());
+				CHIP8_STORE(f + i, _mm256_and_si256(_mm256_srli_epi16(CHIP8_LOAD(x + i), 7), one));
+				const __m256i vx = CHIP8_LOAD(x + i);
+				CHIP8_STORE(x + i, _mm256_add_epi8(vx, vx));
+			}
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+CHIP8_TARGET_AVX2 static void chip8_lockstep_tick_timers_avx2(struct chip8_lockstep* lockstep)
+{
+	const __m256i one = _mm256_set1_epi8(1);
+	for (int i = 0; i < lockstep->padded_lanes; i += 32)
+	{
+		// saturating, so timers at 0 stay at 0
+		CHIP8_STORE(lockstep->delay_timer + i, _mm256_subs_epu8(CHIP8_LOAD(lockstep->delay_timer + i), one));
+		CHIP8_STORE(lockstep->sound_timer + i, _mm256_subs_epu8(CHIP8_LOAD(lockstep->sound_timer + i), one));
+	}
+}
+
+#undef CHIP8_LOAD
+#undef CHIP8_STORE
+
+#endif
+
+/*
+	The same instructions as chip8_lockstep_execute_avx2 plus the ones on I and the timers,
+	one lane at a time. Returns false for the instructions it doesn't handle.
+ */
+static bool chip8_lockstep_execute_scalar(struct chip8_lockstep* lockstep, const struct chip8_instruction* instruction)
+{
+	unsigned char* x = lockstep->V[instruction->x];
+	const unsigned char* y = lockstep->V[instruction->y];
+	unsigned char* f = lockstep->V[0x0F];
+	const int lanes = lockstep->lanes;
+
+	switch (instruction->operation)
+	{
+		case CHIP8_OP_LD_VX_BYTE:
+			memset(x, instruction->kk, lanes);
+			return true;
+
+		case CHIP8_OP_ADD_VX_BYTE:
+			for (int i = 0; i < lanes; i++)
+			{
+				x[i] += instruction->kk;
+			}
+			return true;
+
+		case CHIP8_OP_LD_VX_VY:
+			memmove(x, y, lanes);
+			return true;
+
+		case CHIP8_OP_OR_VX_VY:
+			for (int i = 0; i < lanes; i++)
+			{
+				x[i] |= y[i];
+			}
+			return true;
+
+		case CHIP8_OP_AND_VX_VY:
+			for (int i = 0; i < lanes; i++)
+			{
+				x[i] &= y[i];
+			}
+			return true;
+
+		case CHIP8_OP_XOR_VX_VY:
+			for (int i = 0; i < lanes; i++)
+			{
+				x[i] ^= y[i];
+			}
+			return true;
+
+		case CHIP8_OP_ADD_VX_VY:
+			for (int i = 0; i < lanes; i++)
+			{
+				const unsigned short sum = x[i] + y[i];
+				x[i] = (unsigned char)sum;
+				f[i] = sum > 255;
+			}
+			return true;
+
+		case CHIP8_OP_SUB_VX_VY:
+			for (int i = 0; i < lanes; i++)
+			{
+				f[i] = x[i] > y[i];
+				x[i] -= y[i];
+			}
+			return true;
+
+		case CHIP8_OP_SHR_VX:
+			for (int i = 0; i < lanes; i++)
+			{
+				f[i] = x[i] & 1;
+				x[i] /= 2;
+			}
+			return true;
+
+		case CHIP8_OP_SUBN_VX_VY:
+			for (int i = 0; i < lanes; i++)
+			{
+				f[i] = x[i] < y[i];
+				x[i] = y[i] - x[i];
+			}
+			return true;
+
+		case CHIP8_OP_SHL_VX:
+			for (int i = 0; i < lanes; i++)
+			{
+				f[i] = 0;
+				f[i] = x[i] >> 7;
+				x[i] *= 2;
+			}
+			return true;
+
+		case CHIP8_OP_LD_I_ADDR:
+			for (int i = 0; i < lanes; i++)
+			{
+				lockstep->I[i] = instruction->nnn;
+			}
+			return true;
+
+		case CHIP8_OP_ADD_I_VX:
+			for (int i = 0; i < lanes; i++)
+			{
+				lockstep->I[i] += x[i];
+			}
+			return true;
+
+		case CHIP8_OP_LD_VX_DT:
+			memcpy(x, lockstep->delay_timer, lanes);
+			return true;
+
+		case CHIP8_OP_LD_DT_VX:
+			memcpy(lockstep->delay_timer, x, lanes);
+			return true;
+
+		case CHIP8_OP_LD_ST_VX:
+			memcpy(lockstep->sound_timer, x, lanes);
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+/*
+	Executes the next instruction for all lanes at once. Returns false, without executing
+	anything, when the lanes are at different PCs, when their instruction may differ (its
+	page was written) or when it needs per-lane state such as memory or the screen.
+ */
+static bool chip8_lockstep_step_together(struct chip8_lockstep* lockstep)
+{
+	const unsigned short pc = lockstep->PC[0];
+	unsigned short diverged = 0;
+	for (int i = 1; i < lockstep->lanes; i++)
+	{
+		diverged |= lockstep->PC[i] ^ pc;
+	}
+	if (diverged != 0 || pc + 1 >= CHIP8_MEMORY_SIZE)
+	{
+		return false;
+	}
+
+	const unsigned long long pages = (1ULL << (pc / CHIP8_MEMORY_PAGE_SIZE)) | (1ULL << ((pc + 1) / CHIP8_MEMORY_PAGE_SIZE));
+	if ((lockstep->written_pages & pages) != 0)
+	{
+		return false;
+	}
+
+	// no lane wrote these pages, so lane 0 fetches the instruction every lane shares from the image
+	const struct chip8_instruction* instruction = chip8_decode_cache_fetch(&lockstep->machines[0].decode_cache, &lockstep->machines[0].memory, pc);
+	const unsigned char* x = lockstep->V[instruction->x];
+	const unsigned char* y = lockstep->V[instruction->y];
+	unsigned short* next = lockstep->PC;
+	switch (instruction->operation)
+	{
+		case CHIP8_OP_JP_ADDR:
+			for (int i = 0; i < lockstep->lanes; i++)
+			{
+				next[i] = instruction->nnn;
+			}
+			return true;
+
+		// Skips are where lanes usually diverge
+		case CHIP8_OP_SE_VX_BYTE:
+			for (int i = 0; i < lockstep->lanes; i++)
+			{
+				next[i] = pc + (x[i] == instruction->kk ? 4 : 2);
+			}
+			return true;
+
+		case CHIP8_OP_SNE_VX_BYTE:
+			for (int i = 0; i < lockstep->lanes; i++)
+			{
+				next[i] = pc + (x[i] != instruction->kk ? 4 : 2);
+			}
+			return true;
+
+		case CHIP8_OP_SE_VX_VY:
+			for (int i = 0; i < lockstep->lanes; i++)
+			{
+				next[i] = pc + (x[i] == y[i] ? 4 : 2);
+			}
+			return true;
+
+		case CHIP8_OP_SNE_VX_VY:
+			for (int i = 0; i < lockstep->lanes; i++)
+			{
+				next[i] = pc + (x[i] != y[i] ? 4 : 2);
+			}
+			return true;
+
+		default:
+			break;
+	}
+
+	bool executed = false;
+#ifdef CHIP8_LOCKSTEP_AVX2
+	if (lockstep->use_avx2)
+	{
+		executed = chip8_lockstep_execute_avx2(lockstep, instruction);
+	}
+#endif
+	if (!executed && !chip8_lockstep_execute_scalar(lockstep, instruction))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < lockstep->lanes; i++)
+	{
+		next[i] = pc + 2;
+	}
+	return true;
+}
+
+static void chip8_lockstep_step_lanes(struct chip8_lockstep* lockstep)
+{
+	for (int lane = 0; lane < lockstep->lanes; lane++)
+	{
+		struct chip8* machine = chip8_lockstep_load_lane(lockstep, lane);
+		chip8_step(machine);
+		chip8_lockstep_store_lane(lockstep, lane);
+		lockstep->written_pages |= machine->memory.written_pages;
+	}
+}
+
+struct chip8_lockstep* chip8_lockstep_create(const int lanes)
+{
+	assert(lanes > 0);
+	struct chip8_lockstep* lockstep = calloc(1, sizeof(struct chip8_lockstep));
+	if (lockstep == NULL)
+	{
+		return NULL;
+	}
+
+	lockstep->lanes = lanes;
+	lockstep->padded_lanes = (lanes + CHIP8_LOCKSTEP_LANE_ALIGNMENT - 1) / CHIP8_LOCKSTEP_LANE_ALIGNMENT * CHIP8_LOCKSTEP_LANE_ALIGNMENT;
+#ifdef CHIP8_LOCKSTEP_AVX2
+	lockstep->use_avx2 = chip8_lockstep_host_has_avx2();
+#endif
+
+	const size_t padded = (size_t)lockstep->padded_lanes;
+	bool allocated = true;
+	for (int r = 0; r < CHIP8_TOTAL_DATA_REGISTERS; r++)
+	{
+		lockstep->V[r] = calloc(padded, 1);
+		allocated = allocated && lockstep->V[r] != NULL;
+	}
+	lockstep->I = calloc(padded, sizeof(unsigned short));
+	lockstep->PC = calloc(padded, sizeof(unsigned short));
+	lockstep->delay_timer = calloc(padded, 1);
+	lockstep->sound_timer = calloc(padded, 1);
+	lockstep->machines = calloc(lanes, sizeof(struct chip8));
+	lockstep->image = malloc(sizeof(struct chip8_memory_image));
+	if (!allocated || lockstep->I == NULL || lockstep->PC == NULL || lockstep->delay_timer == NULL
+		|| lockstep->sound_timer == NULL || lockstep->machines == NULL || lockstep->image == NULL)
+	{
+		chip8_lockstep_destroy(lockstep);
+		return NULL;
+	}
+
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		chip8_init(&lockstep->machines[lane]);
+		chip8_lockstep_store_lane(lockstep, lane);
+	}
+	return lockstep;
+}
+
+void chip8_lockstep_destroy(struct chip8_lockstep* lockstep)
+{
+	if (lockstep == NULL)
+	{
+		return;
+	}
+
+	if (lockstep->machines != NULL)
+	{
+		for (int lane = 0; lane < lockstep->lanes; lane++)
+		{
+			chip8_destroy(&lockstep->machines[lane]);
+		}
+	}
+	for (int r = 0; r < CHIP8_TOTAL_DATA_REGISTERS; r++)
+	{
+		free(lockstep->V[r]);
+	}
+	free(lockstep->I);
+	free(lockstep->PC);
+	free(lockstep->delay_timer);
+	free(lockstep->sound_timer);
+	free(lockstep->machines);
+	free(lockstep->image);
+	free(lockstep);
+}
+
+void chip8_lockstep_load(struct chip8_lockstep* lockstep, const char* buf, const size_t size)
+{
+	chip8_image_init(lockstep->image, buf, size);
+	for (int lane = 0; lane < lockstep->lanes; lane++)
+	{
+		struct chip8* machine = chip8_lockstep_load_lane(lockstep, lane);
+		chip8_load_image(machine, lockstep->image);
+		chip8_lockstep_store_lane(lockstep, lane);
+	}
+	lockstep->written_pages = 0;
+}
+
+void chip8_lockstep_seed(struct chip8_lockstep* lockstep, const int lane, const unsigned long long seed)
+{
+	assert(lane >= 0 && lane < lockstep->lanes);
+	chip8_seed(&lockstep->machines[lane], seed);
+}
+
+void chip8_lockstep_run(struct chip8_lockstep* lockstep, const int instructions)
+{
+	for (int i = 0; i < instructions; i++)
+	{
+		if (chip8_lockstep_step_together(lockstep))
+		{
+			lockstep->lockstep_steps++;
+		}
+		else
+		{
+			chip8_lockstep_step_lanes(lockstep);
+			lockstep->divergent_steps++;
+		}
+	}
+}
+
+void chip8_lockstep_tick_timers(struct chip8_lockstep* lockstep)
+{
+#ifdef CHIP8_LOCKSTEP_AVX2
+	if (lockstep->use_avx2)
+	{
+		chip8_lockstep_tick_timers_avx2(lockstep);
+		return;
+	}
+#endif
+	for (int i = 0; i < lockstep->lanes; i++)
+	{
+		if (lockstep->delay_timer[i] > 0)
+		{
+			lockstep->delay_timer[i] -= 1;
+		}
+		if (lockstep->sound_timer[i] > 0)
+		{
+			lockstep->sound_timer[i] -= 1;
+		}
+	}
+}
+
+struct chip8* chip8_lockstep_lane(struct chip8_lockstep* lockstep, const int lane)
+{
+	assert(lane >= 0 && lane < lockstep->lanes);
+	return chip8_lockstep_load_lane(lockstep, lane);
+}
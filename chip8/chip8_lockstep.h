@@ -0,0 +1,62 @@
+#ifndef CHIP8_LOCKSTEP_H
+#define CHIP8_LOCKSTEP_H
+
+#include "chip8.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+	Runs many instances ("lanes") of the same ROM side by side, for searches, fuzzing
+	and batch runs where only the input or the seed differs between instances.
+
+	The registers are kept in structure-of-arrays form (V[r][lane], I[lane], PC[lane]...),
+	so while every lane is at the same PC an instruction is decoded once and executed
+	for all lanes together, 32 lanes per AVX2 instruction when the host supports it.
+	Once the lanes diverge (a skip taken by some lanes only, a key held in one lane...)
+	or the instruction touches memory, the stack, the screen or the keyboard, each lane
+	is stepped on its own by the interpreter until the PCs meet again.
+
+	Memory, stack, keyboard, screen and random generator stay in one struct chip8 per lane,
+	they are only used by the per-lane path.
+ */
+
+// Lanes are allocated in multiples of this, so the vector kernels never need a scalar tail
+#define CHIP8_LOCKSTEP_LANE_ALIGNMENT 32
+
+struct chip8_lockstep
+{
+	int lanes;
+	// lanes rounded up to CHIP8_LOCKSTEP_LANE_ALIGNMENT, the padding lanes are never read back
+	int padded_lanes;
+	bool use_avx2;
+	unsigned char* V[CHIP8_TOTAL_DATA_REGISTERS];
+	unsigned short* I;
+	unsigned short* PC;
+	unsigned char* delay_timer;
+	unsigned char* sound_timer;
+	struct chip8* machines;
+	// The program, shared copy-on-write by every lane
+	struct chip8_memory_image* image;
+	// Pages written by any lane, instructions on them may differ between lanes
+	unsigned long long written_pages;
+	// Steps that ran every lane with one shared instruction, and steps that ran each lane on its own
+	unsigned long long lockstep_steps;
+	unsigned long long divergent_steps;
+};
+
+// Returns NULL when out of memory
+struct chip8_lockstep* chip8_lockstep_create(int lanes);
+void chip8_lockstep_destroy(struct chip8_lockstep* lockstep);
+// Loads the ROM in every lane, all lanes start from the same state
+void chip8_lockstep_load(struct chip8_lockstep* lockstep, const char* buf, size_t size);
+void chip8_lockstep_seed(struct chip8_lockstep* lockstep, int lane, unsigned long long seed);
+// Executes the given number of instructions in every lane
+void chip8_lockstep_run(struct chip8_lockstep* lockstep, int instructions);
+void chip8_lockstep_tick_timers(struct chip8_lockstep* lockstep);
+/*
+	The machine of a lane, with its registers brought up to date.
+	Its keyboard may be changed between runs, changes to its registers are ignored.
+ */
+struct chip8* chip8_lockstep_lane(struct chip8_lockstep* lockstep, int lane);
+
+#endif
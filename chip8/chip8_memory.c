@@ -1,21 +1,71 @@
 #include "chip8_memory.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 static void chip8_is_memory_in_bounds(const int index)
 {
 	assert(index >= 0 && index < CHIP8_MEMORY_SIZE);
 }
 
+void chip8_memory_map(struct chip8_memory* memory, const struct chip8_memory_image* image)
+{
+	memory->image = image;
+	memory->written_pages = 0;
+	memory->total_private_pages = 0;
+}
+
+void chip8_memory_free(struct chip8_memory* memory)
+{
+	free(memory->private_pages);
+	memory->private_pages = NULL;
+	memory->total_private_pages = 0;
+	memory->written_pages = 0;
+}
+
+// Copies a page out of the shared image, the first time it is written
+static void chip8_memory_copy_page(struct chip8_memory* memory, const int page)
+{
+	const int slot = memory->total_private_pages;
+	// Grows in powers of two, keeping the allocation as small as the pages actually written
+	if ((slot & (slot - 1)) == 0)
+	{
+		const size_t capacity = slot == 0 ? 1 : (size_t)slot * 2;
+		void* pages = realloc(memory->private_pages, capacity * CHIP8_MEMORY_PAGE_SIZE);
+		if (pages == NULL)
+		{
+			// A store has no way to report failure, and 64 bytes not being available is hopeless anyway
+			abort();
+		}
+		memory->private_pages = pages;
+	}
+
+	memcpy(memory->private_pages[slot], &memory->image->memory[page * CHIP8_MEMORY_PAGE_SIZE], CHIP8_MEMORY_PAGE_SIZE);
+	memory->page_slots[page] = (unsigned char)slot;
+	memory->total_private_pages++;
+	memory->written_pages |= 1ULL << page;
+}
+
 void chip8_memory_set(struct chip8_memory* memory, const int index, const unsigned char val)
 {
 	chip8_is_memory_in_bounds(index);
-	memory->memory[index] = val;
+	const int page = index / CHIP8_MEMORY_PAGE_SIZE;
+	if ((memory->written_pages & (1ULL << page)) == 0)
+	{
+		chip8_memory_copy_page(memory, page);
+	}
+	memory->private_pages[memory->page_slots[page]][index % CHIP8_MEMORY_PAGE_SIZE] = val;
 }
 
 unsigned char chip8_memory_get(const struct chip8_memory* memory, const int index)
 {
 	chip8_is_memory_in_bounds(index);
-	return memory->memory[index];
+	const int page = index / CHIP8_MEMORY_PAGE_SIZE;
+	if (memory->written_pages & (1ULL << page))
+	{
+		return memory->private_pages[memory->page_slots[page]][index % CHIP8_MEMORY_PAGE_SIZE];
+	}
+	return memory->image->memory[index];
 }
 
 unsigned short chip8_memory_get_short(const struct chip8_memory* memory, const int index)
@@ -23,4 +73,14 @@ unsigned short chip8_memory_get_short(const struct chip8_memory* memory, const i
 	const unsigned char byte1 = chip8_memory_get(memory, index);
 	const unsigned char byte2 = chip8_memory_get(memory, index + 1);
 	return byte1 << 8 | byte2;
-}
\ No newline at end of file
+}
+
+const unsigned char* chip8_memory_page(const struct chip8_memory* memory, const int page)
+{
+	assert(page >= 0 && page < CHIP8_MEMORY_PAGES);
+	if (memory->written_pages & (1ULL << page))
+	{
+		return memory->private_pages[memory->page_slots[page]];
+	}
+	return &memory->image->memory[page * CHIP8_MEMORY_PAGE_SIZE];
+}
@@ -1,6 +1,7 @@
 #ifndef CHIP8_MEMORY_H
 #define CHIP8_MEMORY_H
 #include "config.h"
+#include "chip8_decoder.h"
 
 /*
 	The Chip-8 language is capable of accessing up to 4KB (4,096 bytes) of RAM,
@@ -35,14 +36,41 @@
 
  */
 
-struct chip8_memory
+/*
+	Copy-on-write: the font and the program are kept in an image that every instance
+	running the same program shares read-only. A page (CHIP8_MEMORY_PAGE_SIZE bytes) is
+	copied into the instance on its first write, so an instance only owns the few pages
+	it writes (BCD digits, register dumps) instead of the whole 4KB.
+ */
+struct chip8_memory_image
 {
 	unsigned char memory[CHIP8_MEMORY_SIZE];
+	// 64-bit FNV-1a of memory, set by chip8_image_init. Save states use it to recognise their program.
+	unsigned long long hash;
+	// The instruction starting at every address, decoded by chip8_image_init (CHIP8_OP_NONE otherwise)
+	struct chip8_instruction decoded[CHIP8_MEMORY_SIZE];
 };
 
+struct chip8_memory
+{
+	// Never written through this instance
+	const struct chip8_memory_image* image;
+	// Private copy of page p, valid while bit p of written_pages is set: private_pages[page_slots[p]]
+	unsigned char (*private_pages)[CHIP8_MEMORY_PAGE_SIZE];
+	unsigned char page_slots[CHIP8_MEMORY_PAGES];
+	int total_private_pages;
+	// One bit per CHIP8_MEMORY_PAGE_SIZE bytes, set when the page is written through chip8_memory_set.
+	// Ahead-of-time compiled code checks it to detect that the program overwrote itself.
+	unsigned long long written_pages;
+};
 
+// Maps the image, which must outlive the mapping, and drops every private page
+void chip8_memory_map(struct chip8_memory* memory, const struct chip8_memory_image* image);
+void chip8_memory_free(struct chip8_memory* memory);
 void chip8_memory_set(struct chip8_memory* memory, const int index, const unsigned char val);
 unsigned char chip8_memory_get(const struct chip8_memory* memory, const int index);
 unsigned short chip8_memory_get_short(const struct chip8_memory* memory, const int index);
+// The CHIP8_MEMORY_PAGE_SIZE bytes of a page as the instance sees them, private copy or shared image
+const unsigned char* chip8_memory_page(const struct chip8_memory* memory, int page);
 
 #endif
@@ -0,0 +1,262 @@
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "chip8_platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define CHIP8_NS_PER_SECOND 1000000000ULL
+
+struct chip8_thread
+{
+	chip8_thread_function function;
+	void* argument;
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+};
+
+struct chip8_mutex
+{
+#ifdef _WIN32
+	CRITICAL_SECTION section;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+char* chip8_platform_read_file(const char* filename, size_t* size)
+{
+	FILE* file = fopen(filename, "rb");
+	if (!file)
+	{
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	const long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char* buf = length >= 0 ? malloc((size_t)length + 1) : NULL;
+	if (buf == NULL || fread(buf, 1, (size_t)length, file) != (size_t)length)
+	{
+		free(buf);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+	buf[length] = '\0';
+	*size = (size_t)length;
+	return buf;
+}
+
+#ifdef _WIN32
+
+unsigned long long chip8_platform_time_ns(void)
+{
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// split to avoid overflowing 64 bits
+	const unsigned long long seconds = counter.QuadPart / frequency.QuadPart;
+	const unsigned long long remainder = counter.QuadPart % frequency.QuadPart;
+	return seconds * CHIP8_NS_PER_SECOND + remainder * CHIP8_NS_PER_SECOND / frequency.QuadPart;
+}
+
+void chip8_platform_sleep_ns(const unsigned long long duration)
+{
+	Sleep((DWORD)(duration / 1000000));
+}
+
+int chip8_platform_cpu_count(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+
+static DWORD WINAPI chip8_platform_thread_start(LPVOID parameter)
+{
+	struct chip8_thread* thread = parameter;
+	thread->function(thread->argument);
+	return 0;
+}
+
+struct chip8_thread* chip8_platform_thread_create(const chip8_thread_function function, void* argument)
+{
+	struct chip8_thread* thread = malloc(sizeof(struct chip8_thread));
+	if (thread == NULL)
+	{
+		return NULL;
+	}
+
+	thread->function = function;
+	thread->argument = argument;
+	thread->handle = CreateThread(NULL, 0, chip8_platform_thread_start, thread, 0, NULL);
+	if (thread->handle == NULL)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void chip8_platform_thread_join(struct chip8_thread* thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	free(thread);
+}
+
+struct chip8_mutex* chip8_platform_mutex_create(void)
+{
+	struct chip8_mutex* mutex = malloc(sizeof(struct chip8_mutex));
+	if (mutex != NULL)
+	{
+		InitializeCriticalSection(&mutex->section);
+	}
+	return mutex;
+}
+
+void chip8_platform_mutex_destroy(struct chip8_mutex* mutex)
+{
+	DeleteCriticalSection(&mutex->section);
+	free(mutex);
+}
+
+void chip8_platform_mutex_lock(struct chip8_mutex* mutex)
+{
+	EnterCriticalSection(&mutex->section);
+}
+
+void chip8_platform_mutex_unlock(struct chip8_mutex* mutex)
+{
+	LeaveCriticalSection(&mutex->section);
+}
+
+int chip8_platform_atomic_exchange(volatile int* target, const int value)
+{
+	return (int)InterlockedExchange((volatile LONG*)target, value);
+}
+
+int chip8_platform_atomic_load(volatile int* target)
+{
+	// swapping 0 for 0 changes nothing, and reads with a full barrier
+	return (int)InterlockedCompareExchange((volatile LONG*)target, 0, 0);
+}
+
+#else
+
+unsigned long long chip8_platform_time_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * CHIP8_NS_PER_SECOND + (unsigned long long)now.tv_nsec;
+}
+
+void chip8_platform_sleep_ns(const unsigned long long duration)
+{
+	struct timespec request;
+	request.tv_sec = (time_t)(duration / CHIP8_NS_PER_SECOND);
+	request.tv_nsec = (long)(duration % CHIP8_NS_PER_SECOND);
+	// when interrupted by a signal, sleep for what is left
+	while (nanosleep(&request, &request) == -1 && errno == EINTR)
+	{
+	}
+}
+
+int chip8_platform_cpu_count(void)
+{
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+static void* chip8_platform_thread_start(void* parameter)
+{
+	struct chip8_thread* thread = parameter;
+	thread->function(thread->argument);
+	return NULL;
+}
+
+struct chip8_thread* chip8_platform_thread_create(const chip8_thread_function function, void* argument)
+{
+	struct chip8_thread* thread = malloc(sizeof(struct chip8_thread));
+	if (thread == NULL)
+	{
+		return NULL;
+	}
+
+	thread->function = function;
+	thread->argument = argument;
+	if (pthread_create(&thread->handle, NULL, chip8_platform_thread_start, thread) != 0)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void chip8_platform_thread_join(struct chip8_thread* thread)
+{
+	pthread_join(thread->handle, NULL);
+	free(thread);
+}
+
+struct chip8_mutex* chip8_platform_mutex_create(void)
+{
+	struct chip8_mutex* mutex = malloc(sizeof(struct chip8_mutex));
+	if (mutex != NULL)
+	{
+		pthread_mutex_init(&mutex->mutex, NULL);
+	}
+	return mutex;
+}
+
+void chip8_platform_mutex_destroy(struct chip8_mutex* mutex)
+{
+	pthread_mutex_destroy(&mutex->mutex);
+	free(mutex);
+}
+
+void chip8_platform_mutex_lock(struct chip8_mutex* mutex)
+{
+	pthread_mutex_lock(&mutex->mutex);
+}
+
+void chip8_platform_mutex_unlock(struct chip8_mutex* mutex)
+{
+	pthread_mutex_unlock(&mutex->mutex);
+}
+
+int chip8_platform_atomic_exchange(volatile int* target, const int value)
+{
+	return __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL);
+}
+
+int chip8_platform_atomic_load(volatile int* target)
+{
+	return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+}
+
+#endif
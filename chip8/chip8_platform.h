@@ -0,0 +1,37 @@
+#ifndef CHIP8_PLATFORM_H
+#define CHIP8_PLATFORM_H
+
+#include <stddef.h>
+
+/*
+	The few services the emulator needs from the operating system, so neither the core
+	nor the tools built on it depend on Windows.h or on SDL.
+ */
+
+// Monotonic clock with (at least) microsecond resolution, in nanoseconds since an arbitrary point
+unsigned long long chip8_platform_time_ns(void);
+void chip8_platform_sleep_ns(unsigned long long duration);
+
+// Reads a whole file into a NUL terminated buffer to release with free. Returns NULL on failure.
+char* chip8_platform_read_file(const char* filename, size_t* size);
+
+struct chip8_thread;
+struct chip8_mutex;
+typedef void (*chip8_thread_function)(void* argument);
+
+int chip8_platform_cpu_count(void);
+// Returns NULL when the thread can't be started
+struct chip8_thread* chip8_platform_thread_create(chip8_thread_function function, void* argument);
+// Waits for the thread to finish and releases it
+void chip8_platform_thread_join(struct chip8_thread* thread);
+struct chip8_mutex* chip8_platform_mutex_create(void);
+void chip8_platform_mutex_destroy(struct chip8_mutex* mutex);
+void chip8_platform_mutex_lock(struct chip8_mutex* mutex);
+void chip8_platform_mutex_unlock(struct chip8_mutex* mutex);
+
+// Stores value and returns the previous one, ordered after the writes before it and before the reads after it
+int chip8_platform_atomic_exchange(volatile int* target, int value);
+// Ordered before the reads after it
+int chip8_platform_atomic_load(volatile int* target);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef CHIP8_RANDOM_H
+#define CHIP8_RANDOM_H
+
+/*
+	Random numbers for Cxkk - RND Vx, byte.
+
+	Every instance has its own xorshift64* generator, so runs are reproducible from
+	their seed and instances running on different threads don't share any state.
+ */
+
+struct chip8_random
+{
+	// Never 0, xorshift would only ever produce 0 from it
+	unsigned long long state;
+};
+
+void chip8_random_seed(struct chip8_random* random, unsigned long long seed);
+unsigned char chip8_random_byte(struct chip8_random* random);
+
+#endif
@@ -0,0 +1,296 @@
+#include "chip8_rewind.h"
+#include "chip8_state.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// States are padded with zeros to this size, so every record covers the same bytes
+#define CHIP8_REWIND_STATE_SIZE CHIP8_STATE_MAX_SIZE
+// A zero run takes 2 bytes and a literal 1 byte more than its length, so the encoding is at most twice the size
+#define CHIP8_REWIND_MAX_ENCODED_SIZE (2 * CHIP8_REWIND_STATE_SIZE)
+// Bookkeeping is sized for records of this many bytes on average
+#define CHIP8_REWIND_AVERAGE_RECORD_SIZE 64
+
+/*
+	Encodes state XOR base (state alone when base is NULL) as a sequence of
+	- 0x00-0x7F: a literal of 1 to 128 bytes, which follow
+	- 0x80-0xFF, low: a run of 1 to 32768 zeros, the length being ((control & 0x7F) << 8 | low) + 1
+	Literals only stop at two zeros in a row, which keeps isolated zeros from costing 2 bytes.
+ */
+static size_t chip8_rewind_encode(const unsigned char* state, const unsigned char* base, unsigned char* out)
+{
+	size_t size = 0;
+	int i = 0;
+	while (i < (int)CHIP8_REWIND_STATE_SIZE)
+	{
+		int run = 0;
+		while (i + run < (int)CHIP8_REWIND_STATE_SIZE && run < 0x8000 && (state[i + run] ^ (base != NULL ? base[i + run] : 0)) == 0)
+		{
+			run++;
+		}
+		if (run > 0)
+		{
+			out[size++] = (unsigned char)(0x80 | (run - 1) >> 8);
+			out[size++] = (unsigned char)(run - 1);
+			i += run;
+			continue;
+		}
+
+		const size_t control = size++;
+		int length = 0;
+		while (i < (int)CHIP8_REWIND_STATE_SIZE && length < 0x80)
+		{
+			const unsigned char byte = state[i] ^ (base != NULL ? base[i] : 0);
+			const unsigned char next = i + 1 < (int)CHIP8_REWIND_STATE_SIZE ? state[i + 1] ^ (base != NULL ? base[i + 1] : 0) : 1;
+			if (byte == 0 && next == 0)
+			{
+				break;
+			}
+			out[size++] = byte;
+			length++;
+			i++;
+		}
+		out[control] = (unsigned char)(length - 1);
+	}
+	return size;
+}
+
+static void chip8_rewind_decode(const unsigned char* in, const size_t size, const unsigned char* base, unsigned char* state)
+{
+	size_t read = 0;
+	int i = 0;
+	while (read < size)
+	{
+		const unsigned char control = in[read++];
+		if (control & 0x80)
+		{
+			const int run = ((control & 0x7F) << 8 | in[read++]) + 1;
+			assert(i + run <= (int)CHIP8_REWIND_STATE_SIZE);
+			if (base != NULL)
+			{
+				memcpy(&state[i], &base[i], run);
+			}
+			else
+			{
+				memset(&state[i], 0, run);
+			}
+			i += run;
+		}
+		else
+		{
+			const int length = control + 1;
+			assert(i + length <= (int)CHIP8_REWIND_STATE_SIZE);
+			for (int j = 0; j < length; j++, i++)
+			{
+				state[i] = in[read++] ^ (base != NULL ? base[i] : 0);
+			}
+		}
+	}
+	assert(i == (int)CHIP8_REWIND_STATE_SIZE);
+}
+
+static struct chip8_rewind_record* chip8_rewind_record_at(const struct chip8_rewind* rewind, const int index)
+{
+	return &rewind->records[(rewind->first + index) % rewind->capacity];
+}
+
+// Index of the keyframe the record at index is relative to
+static int chip8_rewind_keyframe_of(const struct chip8_rewind* rewind, int index)
+{
+	while (!chip8_rewind_record_at(rewind, index)->keyframe)
+	{
+		index--;
+		assert(index >= 0);
+	}
+	return index;
+}
+
+static void chip8_rewind_cache_keyframe(struct chip8_rewind* rewind, const int index)
+{
+	const long long number = rewind->first_number + index;
+	if (rewind->cached_keyframe != number)
+	{
+		const struct chip8_rewind_record* record = chip8_rewind_record_at(rewind, index);
+		chip8_rewind_decode(&rewind->data[record->offset], record->size, NULL, rewind->keyframe);
+		rewind->cached_keyframe = number;
+	}
+}
+
+// Drops the oldest keyframe together with the deltas relative to it
+static void chip8_rewind_drop_oldest(struct chip8_rewind* rewind)
+{
+	do
+	{
+		rewind->first = (rewind->first + 1) % rewind->capacity;
+		rewind->first_number++;
+		rewind->total_records--;
+	} while (rewind->total_records > 0 && !chip8_rewind_record_at(rewind, 0)->keyframe);
+
+	if (rewind->cached_keyframe < rewind->first_number)
+	{
+		rewind->cached_keyframe = -1;
+	}
+}
+
+// Finds room for size bytes without dropping anything, returning false when there is none
+static bool chip8_rewind_find_room(const struct chip8_rewind* rewind, const size_t size, size_t* offset)
+{
+	if (rewind->total_records == 0)
+	{
+		*offset = 0;
+		return size <= rewind->data_size;
+	}
+	if (rewind->total_records == rewind->capacity)
+	{
+		return false;
+	}
+
+	const size_t tail = chip8_rewind_record_at(rewind, 0)->offset;
+	if (rewind->head > tail)
+	{
+		// Free space at the end, then at the start up to the oldest record
+		if (size <= rewind->data_size - rewind->head)
+		{
+			*offset = rewind->head;
+			return true;
+		}
+		*offset = 0;
+		return size <= tail;
+	}
+
+	// Wrapped around, the free space is between the newest and the oldest record (none when head == tail)
+	*offset = rewind->head;
+	return size <= tail - rewind->head;
+}
+
+struct chip8_rewind* chip8_rewind_create(const size_t budget, const int keyframe_interval)
+{
+	assert(keyframe_interval > 0);
+	const int capacity = (int)(budget / CHIP8_REWIND_AVERAGE_RECORD_SIZE);
+	const size_t bookkeeping = (size_t)capacity * sizeof(struct chip8_rewind_record);
+	if (capacity == 0 || budget < bookkeeping + CHIP8_REWIND_MAX_ENCODED_SIZE)
+	{
+		return NULL;
+	}
+
+	struct chip8_rewind* rewind = calloc(1, sizeof(struct chip8_rewind));
+	if (rewind == NULL)
+	{
+		return NULL;
+	}
+	rewind->data_size = budget - bookkeeping;
+	rewind->data = malloc(rewind->data_size);
+	rewind->capacity = capacity;
+	rewind->records = calloc(capacity, sizeof(struct chip8_rewind_record));
+	rewind->keyframe_interval = keyframe_interval;
+	rewind->keyframe = malloc(CHIP8_REWIND_STATE_SIZE);
+	rewind->state = malloc(CHIP8_REWIND_STATE_SIZE);
+	rewind->encoded = malloc(CHIP8_REWIND_MAX_ENCODED_SIZE);
+	if (rewind->data == NULL || rewind->records == NULL || rewind->keyframe == NULL || rewind->state == NULL || rewind->encoded == NULL)
+	{
+		chip8_rewind_destroy(rewind);
+		return NULL;
+	}
+
+	chip8_rewind_clear(rewind);
+	return rewind;
+}
+
+void chip8_rewind_destroy(struct chip8_rewind* rewind)
+{
+	if (rewind == NULL)
+	{
+		return;
+	}
+
+	free(rewind->data);
+	free(rewind->records);
+	free(rewind->keyframe);
+	free(rewind->state);
+	free(rewind->encoded);
+	free(rewind);
+}
+
+void chip8_rewind_clear(struct chip8_rewind* rewind)
+{
+	rewind->head = 0;
+	rewind->first = 0;
+	rewind->total_records = 0;
+	rewind->first_number = 0;
+	rewind->cached_keyframe = -1;
+}
+
+void chip8_rewind_push(struct chip8_rewind* rewind, const struct chip8* chip8)
+{
+	const size_t state_size = chip8_save_state(chip8, rewind->state);
+	memset(rewind->state + state_size, 0, CHIP8_REWIND_STATE_SIZE - state_size);
+
+	bool keyframe = rewind->total_records == 0;
+	if (!keyframe)
+	{
+		const int newest = rewind->total_records - 1;
+		const int keyframe_index = chip8_rewind_keyframe_of(rewind, newest);
+		keyframe = newest - keyframe_index + 1 >= rewind->keyframe_interval;
+		if (!keyframe)
+		{
+			chip8_rewind_cache_keyframe(rewind, keyframe_index);
+		}
+	}
+
+	size_t size = chip8_rewind_encode(rewind->state, keyframe ? NULL : rewind->keyframe, rewind->encoded);
+	size_t offset;
+	while (!chip8_rewind_find_room(rewind, size, &offset))
+	{
+		chip8_rewind_drop_oldest(rewind);
+		if (rewind->total_records == 0 && !keyframe)
+		{
+			// The keyframe of the delta had to go, record a keyframe instead
+			keyframe = true;
+			size = chip8_rewind_encode(rewind->state, NULL, rewind->encoded);
+		}
+	}
+
+	struct chip8_rewind_record* record = chip8_rewind_record_at(rewind, rewind->total_records);
+	record->offset = offset;
+	record->size = (unsigned int)size;
+	record->keyframe = keyframe;
+	memcpy(&rewind->data[offset], rewind->encoded, size);
+	rewind->head = offset + size;
+	rewind->total_records++;
+
+	if (keyframe)
+	{
+		memcpy(rewind->keyframe, rewind->state, CHIP8_REWIND_STATE_SIZE);
+		rewind->cached_keyframe = rewind->first_number + rewind->total_records - 1;
+	}
+}
+
+bool chip8_rewind_step_back(struct chip8_rewind* rewind, struct chip8* chip8)
+{
+	if (rewind->total_records == 0)
+	{
+		return false;
+	}
+
+	const int newest = rewind->total_records - 1;
+	const struct chip8_rewind_record* record = chip8_rewind_record_at(rewind, newest);
+	if (record->keyframe)
+	{
+		chip8_rewind_decode(&rewind->data[record->offset], record->size, NULL, rewind->state);
+	}
+	else
+	{
+		chip8_rewind_cache_keyframe(rewind, chip8_rewind_keyframe_of(rewind, newest));
+		chip8_rewind_decode(&rewind->data[record->offset], record->size, rewind->keyframe, rewind->state);
+	}
+
+	// The newest record is always the last one written, so its space can be reused right away
+	rewind->head = record->offset;
+	rewind->total_records--;
+	if (rewind->cached_keyframe >= rewind->first_number + rewind->total_records)
+	{
+		rewind->cached_keyframe = -1;
+	}
+
+	return chip8_load_state(chip8, rewind->state, CHIP8_REWIND_STATE_SIZE);
+}
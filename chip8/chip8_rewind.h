@@ -0,0 +1,62 @@
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+#include "chip8.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+	Rewind: a ring buffer of the save states (see chip8_state.h) of the last frames.
+
+	Every keyframe_interval frames a keyframe is recorded, in between only the XOR of
+	the state against the last keyframe. Most of a delta is zeros, and both kinds of
+	records are run-length encoded, so a frame usually costs tens of bytes.
+	Restoring any frame decodes at most its keyframe (cached) and one delta.
+
+	The buffer never grows: when it is full, the oldest keyframe and the deltas that
+	depend on it are dropped.
+ */
+
+struct chip8_rewind_record
+{
+	size_t offset;
+	unsigned int size;
+	bool keyframe;
+};
+
+struct chip8_rewind
+{
+	// Encoded records, laid out one after the other and wrapping around to the start
+	unsigned char* data;
+	size_t data_size;
+	// Where the next record goes
+	size_t head;
+	// Ring of the records in the order they were pushed
+	struct chip8_rewind_record* records;
+	int capacity;
+	int first;
+	int total_records;
+	int keyframe_interval;
+	// Records are numbered in push order, first_number being the oldest one still kept
+	long long first_number;
+	// Decoded keyframe that deltas are relative to, and its number, -1 when none is decoded
+	unsigned char* keyframe;
+	long long cached_keyframe;
+	// Scratch space for the state being recorded or restored, and for its encoding
+	unsigned char* state;
+	unsigned char* encoded;
+};
+
+/*
+	The budget, in bytes, covers the records and their bookkeeping, about 18KB of scratch
+	space aside. Returns NULL when out of memory or when the budget can't hold one keyframe.
+ */
+struct chip8_rewind* chip8_rewind_create(size_t budget, int keyframe_interval);
+void chip8_rewind_destroy(struct chip8_rewind* rewind);
+void chip8_rewind_clear(struct chip8_rewind* rewind);
+// Records the state of the instance, call it once per frame before running the frame
+void chip8_rewind_push(struct chip8_rewind* rewind, const struct chip8* chip8);
+// Restores the most recently recorded frame and forgets it. Returns false when there is none left.
+bool chip8_rewind_step_back(struct chip8_rewind* rewind, struct chip8* chip8);
+
+#endif
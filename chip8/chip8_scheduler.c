@@ -0,0 +1,256 @@
+#include "chip8_scheduler.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct chip8_scheduler* chip8_scheduler_create(const int quantum)
+{
+	assert(quantum > 0);
+	struct chip8_scheduler* scheduler = calloc(1, sizeof(struct chip8_scheduler));
+	if (scheduler != NULL)
+	{
+		scheduler->quantum = quantum;
+	}
+	return scheduler;
+}
+
+void chip8_scheduler_destroy(struct chip8_scheduler* scheduler)
+{
+	if (scheduler == NULL)
+	{
+		return;
+	}
+
+	free(scheduler->slots);
+	free(scheduler->runnable);
+	free(scheduler->pending);
+	free(scheduler->wakeups);
+	free(scheduler);
+}
+
+static bool chip8_scheduler_reserve(struct chip8_scheduler* scheduler)
+{
+	if (scheduler->total_slots < scheduler->capacity)
+	{
+		return true;
+	}
+
+	const int capacity = scheduler->capacity > 0 ? scheduler->capacity * 2 : 16;
+	struct chip8_scheduler_slot* slots = realloc(scheduler->slots, capacity * sizeof(struct chip8_scheduler_slot));
+	if (slots == NULL)
+	{
+		return false;
+	}
+	scheduler->slots = slots;
+	int* runnable = realloc(scheduler->runnable, capacity * sizeof(int));
+	if (runnable == NULL)
+	{
+		return false;
+	}
+	scheduler->runnable = runnable;
+	int* pending = realloc(scheduler->pending, capacity * sizeof(int));
+	if (pending == NULL)
+	{
+		return false;
+	}
+	scheduler->pending = pending;
+	scheduler->capacity = capacity;
+	return true;
+}
+
+int chip8_scheduler_add(struct chip8_scheduler* scheduler, struct chip8* chip8)
+{
+	if (!chip8_scheduler_reserve(scheduler))
+	{
+		return -1;
+	}
+
+	const int slot = scheduler->total_slots++;
+	memset(&scheduler->slots[slot], 0, sizeof(struct chip8_scheduler_slot));
+	scheduler->slots[slot].chip8 = chip8;
+	scheduler->slots[slot].state = CHIP8_SCHEDULER_RUNNABLE;
+	scheduler->slots[slot].ticks = scheduler->ticks;
+	scheduler->runnable[scheduler->total_runnable++] = slot;
+	return slot;
+}
+
+static void chip8_scheduler_swap_wakeups(struct chip8_scheduler* scheduler, const int a, const int b)
+{
+	const struct chip8_scheduler_wakeup wakeup = scheduler->wakeups[a];
+	scheduler->wakeups[a] = scheduler->wakeups[b];
+	scheduler->wakeups[b] = wakeup;
+}
+
+static bool chip8_scheduler_push_wakeup(struct chip8_scheduler* scheduler, const unsigned long long tick, const int slot)
+{
+	if (scheduler->total_wakeups == scheduler->wakeups_capacity)
+	{
+		const int capacity = scheduler->wakeups_capacity > 0 ? scheduler->wakeups_capacity * 2 : 16;
+		struct chip8_scheduler_wakeup* wakeups = realloc(scheduler->wakeups, capacity * sizeof(struct chip8_scheduler_wakeup));
+		if (wakeups == NULL)
+		{
+			return false;
+		}
+		scheduler->wakeups = wakeups;
+		scheduler->wakeups_capacity = capacity;
+	}
+
+	int i = scheduler->total_wakeups++;
+	scheduler->wakeups[i].tick = tick;
+	scheduler->wakeups[i].slot = slot;
+	while (i > 0 && scheduler->wakeups[(i - 1) / 2].tick > scheduler->wakeups[i].tick)
+	{
+		chip8_scheduler_swap_wakeups(scheduler, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	return true;
+}
+
+static struct chip8_scheduler_wakeup chip8_scheduler_pop_wakeup(struct chip8_scheduler* scheduler)
+{
+	const struct chip8_scheduler_wakeup first = scheduler->wakeups[0];
+	scheduler->wakeups[0] = scheduler->wakeups[--scheduler->total_wakeups];
+	int i = 0;
+	while (1)
+	{
+		const int left = 2 * i + 1;
+		const int right = left + 1;
+		int smallest = i;
+		if (left < scheduler->total_wakeups && scheduler->wakeups[left].tick < scheduler->wakeups[smallest].tick)
+		{
+			smallest = left;
+		}
+		if (right < scheduler->total_wakeups && scheduler->wakeups[right].tick < scheduler->wakeups[smallest].tick)
+		{
+			smallest = right;
+		}
+		if (smallest == i)
+		{
+			return first;
+		}
+		chip8_scheduler_swap_wakeups(scheduler, i, smallest);
+		i = smallest;
+	}
+}
+
+// Fast-forwards a parked instance over the ticks it missed
+static void chip8_scheduler_catch_up(struct chip8_scheduler* scheduler, struct chip8_scheduler_slot* slot)
+{
+	for (; slot->ticks < scheduler->ticks; slot->ticks++)
+	{
+		chip8_advance(slot->chip8, slot->chip8->clock.until_tick);
+	}
+}
+
+static void chip8_scheduler_wake(struct chip8_scheduler* scheduler, const int slot)
+{
+	struct chip8_scheduler_slot* woken = &scheduler->slots[slot];
+	if (woken->state == CHIP8_SCHEDULER_RUNNABLE)
+	{
+		return;
+	}
+
+	chip8_scheduler_catch_up(scheduler, woken);
+	woken->state = CHIP8_SCHEDULER_RUNNABLE;
+	scheduler->runnable[scheduler->total_runnable++] = slot;
+}
+
+// Decides whether an instance that just finished a tick is worth running the next one
+static bool chip8_scheduler_park(struct chip8_scheduler* scheduler, const int slot)
+{
+	struct chip8_scheduler_slot* parked = &scheduler->slots[slot];
+	switch (chip8_activity(parked->chip8))
+	{
+		case CHIP8_IDLE:
+			// the wait loop sees the timer at 0 on the tick after it runs out
+			parked->wake_tick = scheduler->ticks + parked->chip8->registers.delay_timer;
+			if (!chip8_scheduler_push_wakeup(scheduler, parked->wake_tick, slot))
+			{
+				return false;
+			}
+			parked->state = CHIP8_SCHEDULER_SLEEPING;
+			return true;
+
+		case CHIP8_WAITING_KEY:
+		case CHIP8_HALTED:
+			parked->state = CHIP8_SCHEDULER_PARKED;
+			return true;
+
+		case CHIP8_RUNNING:
+		default:
+			return false;
+	}
+}
+
+void chip8_scheduler_tick(struct chip8_scheduler* scheduler)
+{
+	while (scheduler->total_wakeups > 0 && scheduler->wakeups[0].tick <= scheduler->ticks)
+	{
+		const struct chip8_scheduler_wakeup wakeup = chip8_scheduler_pop_wakeup(scheduler);
+		const struct chip8_scheduler_slot* slot = &scheduler->slots[wakeup.slot];
+		if (slot->state == CHIP8_SCHEDULER_SLEEPING && slot->wake_tick == wakeup.tick)
+		{
+			chip8_scheduler_wake(scheduler, wakeup.slot);
+		}
+	}
+
+	// Every runnable instance runs up to its next tick, a slice at a time in turn
+	int total_pending = scheduler->total_runnable;
+	for (int i = 0; i < total_pending; i++)
+	{
+		struct chip8_scheduler_slot* slot = &scheduler->slots[scheduler->runnable[i]];
+		slot->remaining = slot->chip8->clock.until_tick;
+		scheduler->pending[i] = scheduler->runnable[i];
+	}
+	while (total_pending > 0)
+	{
+		int still_pending = 0;
+		for (int i = 0; i < total_pending; i++)
+		{
+			struct chip8_scheduler_slot* slot = &scheduler->slots[scheduler->pending[i]];
+			const int slice = slot->remaining < scheduler->quantum ? slot->remaining : scheduler->quantum;
+			chip8_advance(slot->chip8, slice);
+			slot->remaining -= slice;
+			scheduler->slices++;
+			if (slot->remaining > 0)
+			{
+				scheduler->pending[still_pending++] = scheduler->pending[i];
+			}
+		}
+		total_pending = still_pending;
+	}
+	scheduler->ticks++;
+
+	int still_runnable = 0;
+	for (int i = 0; i < scheduler->total_runnable; i++)
+	{
+		const int slot = scheduler->runnable[i];
+		scheduler->slots[slot].ticks = scheduler->ticks;
+		if (!chip8_scheduler_park(scheduler, slot))
+		{
+			scheduler->runnable[still_runnable++] = slot;
+		}
+	}
+	scheduler->total_runnable = still_runnable;
+}
+
+void chip8_scheduler_key_down(struct chip8_scheduler* scheduler, const int slot, const int key)
+{
+	assert(slot >= 0 && slot < scheduler->total_slots);
+	chip8_scheduler_wake(scheduler, slot);
+	chip8_keyboard_down(&scheduler->slots[slot].chip8->keyboard, key);
+}
+
+void chip8_scheduler_key_up(struct chip8_scheduler* scheduler, const int slot, const int key)
+{
+	assert(slot >= 0 && slot < scheduler->total_slots);
+	chip8_scheduler_wake(scheduler, slot);
+	chip8_keyboard_up(&scheduler->slots[slot].chip8->keyboard, key);
+}
+
+struct chip8* chip8_scheduler_sync(struct chip8_scheduler* scheduler, const int slot)
+{
+	assert(slot >= 0 && slot < scheduler->total_slots);
+	chip8_scheduler_catch_up(scheduler, &scheduler->slots[slot]);
+	return scheduler->slots[slot].chip8;
+}
@@ -0,0 +1,81 @@
+#ifndef CHIP8_SCHEDULER_H
+#define CHIP8_SCHEDULER_H
+
+#include "chip8.h"
+#include <stdbool.h>
+
+/*
+	Time-slices many instances on one thread, for hosting large numbers of (mostly idle)
+	sessions without paying for an OS thread each.
+
+	All instances share the scheduler's clock: every chip8_scheduler_tick runs one tick of
+	each instance's virtual clock (see chip8_clock.h), in slices of at most quantum
+	instructions taken in turn, so an instance running many instructions per tick can't
+	hold the thread while the others wait.
+
+	Instances that can't do anything observable are parked and cost nothing until woken:
+	- waiting on the delay timer (CHIP8_IDLE) sleep until the tick it runs out
+	- waiting for a key (CHIP8_WAITING_KEY) or halted sleep until a key event
+	A parked instance falls behind the scheduler's clock and is fast-forwarded, with the
+	same result as running it, when it wakes up or is synced.
+ */
+
+enum chip8_scheduler_state
+{
+	CHIP8_SCHEDULER_RUNNABLE = 0,
+	// Parked until wake_tick
+	CHIP8_SCHEDULER_SLEEPING,
+	// Parked until a key event
+	CHIP8_SCHEDULER_PARKED
+};
+
+struct chip8_scheduler_slot
+{
+	struct chip8* chip8;
+	enum chip8_scheduler_state state;
+	// Ticks the instance has run, behind the scheduler's while it is parked
+	unsigned long long ticks;
+	unsigned long long wake_tick;
+	// Instructions left in the tick being run
+	int remaining;
+};
+
+struct chip8_scheduler_wakeup
+{
+	unsigned long long tick;
+	int slot;
+};
+
+struct chip8_scheduler
+{
+	struct chip8_scheduler_slot* slots;
+	int total_slots;
+	int capacity;
+	// Runnable slots in turn order, and the ones that haven't finished the tick being run
+	int* runnable;
+	int total_runnable;
+	int* pending;
+	// Min-heap of the sleeping slots by wake tick. Slots woken early by a key leave a stale entry behind.
+	struct chip8_scheduler_wakeup* wakeups;
+	int total_wakeups;
+	int wakeups_capacity;
+	int quantum;
+	unsigned long long ticks;
+	// Slices run since creation
+	unsigned long long slices;
+};
+
+// Returns NULL when out of memory
+struct chip8_scheduler* chip8_scheduler_create(int quantum);
+// The instances are left alone, they belong to the caller
+void chip8_scheduler_destroy(struct chip8_scheduler* scheduler);
+// The instance, loaded and set up, joins at the current tick. Returns its slot, or -1 when out of memory.
+int chip8_scheduler_add(struct chip8_scheduler* scheduler, struct chip8* chip8);
+void chip8_scheduler_tick(struct chip8_scheduler* scheduler);
+// Keys must go through the scheduler, which wakes the instance first
+void chip8_scheduler_key_down(struct chip8_scheduler* scheduler, int slot, int key);
+void chip8_scheduler_key_up(struct chip8_scheduler* scheduler, int slot, int key);
+// Brings a parked instance up to the current tick (without waking it) and returns it, e.g. to read its timers
+struct chip8* chip8_scheduler_sync(struct chip8_scheduler* scheduler, int slot);
+
+#endif
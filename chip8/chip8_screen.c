@@ -2,51 +2,98 @@
 #include <assert.h>
 #include <memory.h>
 
+_Static_assert(CHIP8_WIDTH == 64, "A screen row must fit exactly in a 64-bit word");
+_Static_assert(CHIP8_HEIGHT <= 32, "Every row needs a bit of dirty_rows");
+
 static void chip8_screen_check_bounds(const int x, const int y)
 {
-	assert(x >= 0 && CHIP8_WIDTH && y >= 0 && y < CHIP8_HEIGHT);
+	assert(x >= 0 && x < CHIP8_WIDTH && y >= 0 && y < CHIP8_HEIGHT);
+}
+
+static unsigned long long chip8_screen_mask(const int x)
+{
+	return 1ULL << (CHIP8_WIDTH - 1 - x);
+}
+
+// Rotating (instead of shifting) takes care of sprites wrapping around the right edge
+static unsigned long long chip8_screen_rotate_right(const unsigned long long row, const int shift)
+{
+	if (shift == 0)
+	{
+		return row;
+	}
+
+	return row >> shift | row << (CHIP8_WIDTH - shift);
 }
 
 void chip8_screen_set(struct chip8_screen* screen, const int x, const int y)
 {
 	chip8_screen_check_bounds(x, y);
-	screen->pixels[y][x] = true;
+	screen->pixels[y] |= chip8_screen_mask(x);
+	screen->dirty_rows |= 1u << y;
 }
 
 void chip8_screen_clear(struct chip8_screen* screen)
 {
+	for (int y = 0; y < CHIP8_HEIGHT; y++)
+	{
+		if (screen->pixels[y] != 0)
+		{
+			screen->dirty_rows |= 1u << y;
+		}
+	}
 	memset(screen->pixels, 0, sizeof(screen->pixels));
 }
 
+unsigned int chip8_screen_take_dirty_rows(struct chip8_screen* screen)
+{
+	const unsigned int dirty_rows = screen->dirty_rows;
+	screen->dirty_rows = 0;
+	return dirty_rows;
+}
+
 bool chip8_screen_is_set(const struct chip8_screen* screen, const int x, const int y)
 {
 	chip8_screen_check_bounds(x, y);
-	return screen->pixels[y][x];
+	return (screen->pixels[y] & chip8_screen_mask(x)) != 0;
 }
 
 bool chip8_screen_draw_sprite(struct chip8_screen* screen, const int x, const int y, const char* sprite, const int num)
 {
-	bool pixel_collision = false;
+	const int shift = x % CHIP8_WIDTH;
+	unsigned long long collision = 0;
 
 	for (int ly = 0; ly < num; ly++)
 	{
-		const char c = sprite[ly];
-		for (int lx = 0; lx < 8; lx++)
+		// place the 8 sprite pixels at the top of the word, then move them to column x
+		const unsigned long long row = (unsigned long long)(unsigned char)sprite[ly] << (CHIP8_WIDTH - 8);
+		const unsigned long long sprite_row = chip8_screen_rotate_right(row, shift);
+		const int py = (ly + y) % CHIP8_HEIGHT;
+		unsigned long long* pixels = &screen->pixels[py];
+
+		collision |= *pixels & sprite_row;
+		*pixels ^= sprite_row;
+		// XORing a blank sprite row changes nothing
+		if (sprite_row != 0)
+		{
+			screen->dirty_rows |= 1u << py;
+		}
+	}
+
+	return collision != 0;
+}
+
+unsigned long long chip8_screen_hash(const struct chip8_screen* screen)
+{
+	unsigned long long hash = 0xCBF29CE484222325ULL;
+	for (int y = 0; y < CHIP8_HEIGHT; y++)
+	{
+		for (int shift = 56; shift >= 0; shift -= 8)
 		{
-			if ((c & (0b10000000 >> lx)) == 0)  // NOLINT(clang-diagnostic-gnu-binary-literal)
-			{
-				continue;
-			}
-
-			if (screen->pixels[(ly + y) % CHIP8_HEIGHT][(lx + x) % CHIP8_WIDTH])
-			{
-				pixel_collision = true;
-			}
-
-			// set the pixel taking the wrapping of the screen into consideration using the % operator
-			screen->pixels[(ly + y) % CHIP8_HEIGHT][(lx + x) % CHIP8_WIDTH] ^= true;
+			hash ^= screen->pixels[y] >> shift & 0xFF;
+			hash *= 0x100000001B3ULL;
 		}
 	}
 
-	return pixel_collision;
+	return hash;
 }
@@ -27,15 +27,28 @@
 	in the interpreter area of Chip-8 memory (0x000 to 0x1FF)
 */
 
+/*
+	Each row of the display is packed into a single 64-bit word. The most significant
+	bit is the leftmost pixel (x = 0) and the least significant bit is the rightmost one
+	(x = 63), so a sprite byte shifted into the top of a word lines up with the screen.
+ */
 struct chip8_screen
 {
-	bool pixels[CHIP8_HEIGHT][CHIP8_WIDTH];
+	unsigned long long pixels[CHIP8_HEIGHT];
+	// Bit y set when row y was changed since the rows were last taken
+	unsigned int dirty_rows;
 };
 
+#define CHIP8_SCREEN_ALL_ROWS (0xFFFFFFFFu >> (32 - CHIP8_HEIGHT))
+
 void chip8_screen_set(struct chip8_screen* screen, int x, int y);
 bool chip8_screen_is_set(const struct chip8_screen* screen, int x, int y);
 bool chip8_screen_draw_sprite(struct chip8_screen* screen, int x, int y, const char* sprite, int num);
 void chip8_screen_clear(struct chip8_screen* screen);
+// Returns the rows changed since the last call, so a frontend can upload only those, and starts over
+unsigned int chip8_screen_take_dirty_rows(struct chip8_screen* screen);
+// 64-bit FNV-1a hash of the pixels, row by row from the leftmost pixel, the same on every host
+unsigned long long chip8_screen_hash(const struct chip8_screen* screen);
 
 #endif
 
@@ -0,0 +1,109 @@
+#include "chip8_script.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool chip8_script_parse_line(const char* line, struct chip8_script_event* event)
+{
+	unsigned int frame;
+	char action[5];
+	unsigned int key;
+	char trailing;
+	if (sscanf(line, "%u %4s %x %c", &frame, action, &key, &trailing) != 3 || key >= CHIP_TOTAL_KEYS)
+	{
+		return false;
+	}
+
+	if (strcmp(action, "down") == 0)
+	{
+		event->down = true;
+	}
+	else if (strcmp(action, "up") == 0)
+	{
+		event->down = false;
+	}
+	else
+	{
+		return false;
+	}
+
+	event->frame = frame;
+	event->key = (unsigned char)key;
+	return true;
+}
+
+bool chip8_script_parse(struct chip8_script* script, const char* text, int* error_line)
+{
+	memset(script, 0, sizeof(struct chip8_script));
+
+	size_t capacity = 0;
+	int line_number = 0;
+	const char* line = text;
+	while (*line != '\0')
+	{
+		line_number++;
+		const char* end = strchr(line, '\n');
+		const size_t length = end ? (size_t)(end - line) : strlen(line);
+
+		char buffer[128];
+		const size_t copied = length < sizeof(buffer) - 1 ? length : sizeof(buffer) - 1;
+		memcpy(buffer, line, copied);
+		buffer[copied] = '\0';
+		line = end ? end + 1 : line + length;
+
+		const char* content = buffer + strspn(buffer, " \t\r");
+		if (*content == '\0' || *content == '#')
+		{
+			continue;
+		}
+
+		if (script->total_events == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 16;
+			struct chip8_script_event* events = realloc(script->events, capacity * sizeof(struct chip8_script_event));
+			if (events == NULL)
+			{
+				chip8_script_free(script);
+				return false;
+			}
+			script->events = events;
+		}
+
+		struct chip8_script_event* event = &script->events[script->total_events];
+		if (!chip8_script_parse_line(content, event)
+			|| (script->total_events > 0 && event->frame < script->events[script->total_events - 1].frame))
+		{
+			if (error_line != NULL)
+			{
+				*error_line = line_number;
+			}
+			chip8_script_free(script);
+			return false;
+		}
+		script->total_events++;
+	}
+
+	return true;
+}
+
+void chip8_script_free(struct chip8_script* script)
+{
+	free(script->events);
+	memset(script, 0, sizeof(struct chip8_script));
+}
+
+void chip8_script_apply(struct chip8_script* script, struct chip8_keyboard* keyboard, const unsigned int frame)
+{
+	while (script->next < script->total_events && script->events[script->next].frame <= frame)
+	{
+		const struct chip8_script_event* event = &script->events[script->next++];
+		if (event->down)
+		{
+			chip8_keyboard_down(keyboard, event->key);
+		}
+		else
+		{
+			chip8_keyboard_up(keyboard, event->key);
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef CHIP8_SCRIPT_H
+#define CHIP8_SCRIPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "chip8_keyboard.h"
+
+/*
+	Scripted input for headless runs. A script is plain text with one event per line:
+
+	<frame> down|up <key>
+
+	where frame is the frame number (0 is the first frame) and key the Chip-8 key in
+	hexadecimal. Events must be in frame order. Empty lines and lines starting with #
+	are ignored. For example, to press 5 for a tenth of a second at the start:
+
+	0 down 5
+	6 up 5
+ */
+
+struct chip8_script_event
+{
+	unsigned int frame;
+	unsigned char key;
+	bool down;
+};
+
+struct chip8_script
+{
+	struct chip8_script_event* events;
+	size_t total_events;
+	// Next event to apply
+	size_t next;
+};
+
+// Returns false on a syntax error, reporting the line in *error_line when it's not NULL
+bool chip8_script_parse(struct chip8_script* script, const char* text, int* error_line);
+void chip8_script_free(struct chip8_script* script);
+// Applies the events of the given frame, call it once per frame before running it
+void chip8_script_apply(struct chip8_script* script, struct chip8_keyboard* keyboard, unsigned int frame);
+
+#endif
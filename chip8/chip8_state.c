@@ -0,0 +1,121 @@
+#include "chip8_state.h"
+#include <assert.h>
+#include <string.h>
+
+static int chip8_state_total_pages(unsigned long long pages)
+{
+	int total = 0;
+	for (; pages != 0; pages &= pages - 1)
+	{
+		total++;
+	}
+	return total;
+}
+
+size_t chip8_save_state(const struct chip8* chip8, void* buf)
+{
+	assert(((size_t)buf & 7) == 0);
+	struct chip8_state* state = buf;
+	memset(state, 0, sizeof(struct chip8_state));
+	state->magic = CHIP8_STATE_MAGIC;
+	state->version = CHIP8_STATE_VERSION;
+	state->image_hash = chip8->memory.image->hash;
+	memcpy(state->pixels, chip8->screen.pixels, sizeof(state->pixels));
+	state->random_state = chip8->random.state;
+	memcpy(state->stack, chip8->stack.stack, sizeof(state->stack));
+	state->I = chip8->registers.I;
+	state->PC = chip8->registers.PC;
+	for (int key = 0; key < CHIP_TOTAL_KEYS; key++)
+	{
+		if (chip8->keyboard.keyboard[key])
+		{
+			state->keys |= (uint16_t)(1 << key);
+		}
+	}
+	memcpy(state->V, chip8->registers.V, sizeof(state->V));
+	state->delay_timer = chip8->registers.delay_timer;
+	state->sound_timer = chip8->registers.sound_timer;
+	state->SP = chip8->registers.SP;
+	state->until_tick = (uint32_t)chip8->clock.until_tick;
+	state->waiting_key = chip8->keyboard.waiting;
+	state->pressed_key = (uint8_t)chip8->keyboard.pressed_key;
+
+	// Pages that were written but hold what the program image holds are left out
+	unsigned char* data = (unsigned char*)(state + 1);
+	for (int page = 0; page < CHIP8_MEMORY_PAGES; page++)
+	{
+		if ((chip8->memory.written_pages & (1ULL << page)) == 0)
+		{
+			continue;
+		}
+		const unsigned char* memory = chip8_memory_page(&chip8->memory, page);
+		if (memcmp(memory, &chip8->memory.image->memory[page * CHIP8_MEMORY_PAGE_SIZE], CHIP8_MEMORY_PAGE_SIZE) != 0)
+		{
+			memcpy(data, memory, CHIP8_MEMORY_PAGE_SIZE);
+			data += CHIP8_MEMORY_PAGE_SIZE;
+			state->pages |= 1ULL << page;
+		}
+	}
+
+	state->size = (uint32_t)(data - (unsigned char*)buf);
+	return state->size;
+}
+
+bool chip8_load_state(struct chip8* chip8, const void* buf, const size_t size)
+{
+	const struct chip8_state* state = buf;
+	if (size < sizeof(struct chip8_state) || state->magic != CHIP8_STATE_MAGIC || state->version != CHIP8_STATE_VERSION)
+	{
+		return false;
+	}
+
+	const size_t expected_size = sizeof(struct chip8_state) + (size_t)chip8_state_total_pages(state->pages) * CHIP8_MEMORY_PAGE_SIZE;
+	if (state->size != expected_size || state->size > size || state->image_hash != chip8->memory.image->hash
+		|| state->PC >= CHIP8_MEMORY_SIZE || state->SP > CHIP8_TOTAL_STACK_DEPTH)
+	{
+		return false;
+	}
+
+	// Drops the private pages and everything decoded or compiled from them
+	chip8_load_image(chip8, chip8->memory.image);
+	const unsigned char* data = (const unsigned char*)(state + 1);
+	for (int page = 0; page < CHIP8_MEMORY_PAGES; page++)
+	{
+		if ((state->pages & (1ULL << page)) == 0)
+		{
+			continue;
+		}
+		for (int i = 0; i < CHIP8_MEMORY_PAGE_SIZE; i++)
+		{
+			chip8_memory_set(&chip8->memory, page * CHIP8_MEMORY_PAGE_SIZE + i, data[i]);
+		}
+		data += CHIP8_MEMORY_PAGE_SIZE;
+	}
+
+	for (int y = 0; y < CHIP8_HEIGHT; y++)
+	{
+		if (chip8->screen.pixels[y] != state->pixels[y])
+		{
+			chip8->screen.pixels[y] = state->pixels[y];
+			chip8->screen.dirty_rows |= 1u << y;
+		}
+	}
+	chip8->random.state = state->random_state;
+	memcpy(chip8->stack.stack, state->stack, sizeof(state->stack));
+	chip8->registers.I = state->I;
+	chip8->registers.PC = state->PC;
+	for (int key = 0; key < CHIP_TOTAL_KEYS; key++)
+	{
+		chip8->keyboard.keyboard[key] = (state->keys >> key & 1) != 0;
+	}
+	memcpy(chip8->registers.V, state->V, sizeof(state->V));
+	chip8->registers.delay_timer = state->delay_timer;
+	chip8->registers.sound_timer = state->sound_timer;
+	chip8->registers.SP = state->SP;
+	chip8->keyboard.waiting = state->waiting_key != 0;
+	chip8->keyboard.pressed_key = state->pressed_key < CHIP_TOTAL_KEYS ? state->pressed_key : -1;
+	// The rate is a setting of the host, which may have changed since the state was saved
+	const bool until_tick_valid = state->until_tick > 0 && state->until_tick <= (uint32_t)chip8->clock.instructions_per_tick;
+	chip8->clock.until_tick = until_tick_valid ? (int)state->until_tick : chip8->clock.instructions_per_tick;
+	return true;
+}
@@ -0,0 +1,69 @@
+#ifndef CHIP8_STATE_H
+#define CHIP8_STATE_H
+
+#include "chip8.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	Save states: a snapshot of everything the program can observe, for checkpointing
+	and restarting long runs.
+
+	A state is a fixed-layout header followed by the memory pages (CHIP8_MEMORY_PAGE_SIZE
+	bytes each, lowest first) that differ from the program image, so a typical state is
+	a few hundred bytes. There are no pointers and no variable-length fields before the
+	pages, and every state is a multiple of 8 bytes: a file of states written back to
+	back can be mapped into memory and each one used in place, stepping by its size.
+	Values are in host byte order.
+
+	The keyboard map and the engine are settings of the host, not part of the state.
+ */
+
+#define CHIP8_STATE_MAGIC 0x53384843u
+#define CHIP8_STATE_VERSION 3
+
+struct chip8_state
+{
+	// CHIP8_STATE_MAGIC ("CH8S")
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	// Bytes, including the pages that follow the header
+	uint32_t size;
+	// Instructions left until the virtual clock ticks the timers
+	uint32_t until_tick;
+	// chip8_memory_image.hash of the program the state was saved from
+	uint64_t image_hash;
+	uint64_t pixels[CHIP8_HEIGHT];
+	uint64_t random_state;
+	// One bit per page stored after the header
+	uint64_t pages;
+	uint16_t stack[CHIP8_TOTAL_STACK_DEPTH];
+	uint16_t I;
+	uint16_t PC;
+	// Bit k set while key k is down
+	uint16_t keys;
+	uint8_t V[CHIP8_TOTAL_DATA_REGISTERS];
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint8_t SP;
+	// Non-zero while Fx0A waits, and the key it latched (0xFF for none yet)
+	uint8_t waiting_key;
+	uint8_t pressed_key;
+	uint8_t padding[5];
+};
+
+// Room chip8_save_state may need
+#define CHIP8_STATE_MAX_SIZE (sizeof(struct chip8_state) + CHIP8_MEMORY_SIZE)
+
+// Writes the state to buf, which must hold CHIP8_STATE_MAX_SIZE bytes and be 8-byte aligned. Returns its size.
+size_t chip8_save_state(const struct chip8* chip8, void* buf);
+/*
+	Restores a state saved from an instance running the same program (loaded with
+	chip8_load or chip8_load_image). Returns false, leaving the instance untouched, when
+	the state is truncated, of another version, or was saved from another program.
+ */
+bool chip8_load_state(struct chip8* chip8, const void* buf, size_t size);
+
+#endif
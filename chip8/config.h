@@ -8,11 +8,62 @@
 #define CHIP8_WIDTH 64
 #define CHIP8_HEIGHT 32
 #define CHIP8_WINDOW_SCALE 20
+#define CHIP8_PIXEL_ON_COLOR 0xFFFFFFFF
+#define CHIP8_PIXEL_OFF_COLOR 0xFF000000
+// The tone played while the sound timer runs, a square wave
+#define CHIP8_TONE_FREQUENCY 400
+#define CHIP8_AUDIO_AMPLITUDE 3000
+#define CHIP8_AUDIO_SAMPLE_RATE 44100
+#define CHIP8_AUDIO_BUFFER_SAMPLES 512
 #define CHIP8_TOTAL_DATA_REGISTERS 16
 #define CHIP8_TOTAL_STACK_DEPTH 16
 #define CHIP_TOTAL_KEYS 16
+// Granularity at which writes to memory are tracked and copied on write
+#define CHIP8_MEMORY_PAGES 64
+#define CHIP8_MEMORY_PAGE_SIZE (CHIP8_MEMORY_SIZE / CHIP8_MEMORY_PAGES)
 #define CHIP8_CHARACTER_SET_LOAD_ADDRESS 0x00
 #define CHIP8_DEFAULT_SPRITE_HEIGHT 5
+#define CHIP8_FRAMES_PER_SECOND 60
+// Seed of the random number generator after chip8_init, see chip8_seed
+#define CHIP8_DEFAULT_RANDOM_SEED 0x43484950
+#define CHIP8_INSTRUCTIONS_PER_FRAME 10
+// Key events the frontend can queue for the emulation thread, a power of two
+#define CHIP8_INPUT_QUEUE_SIZE 64
+// Longest the frontend waits for input before checking for a new screen
+#define CHIP8_RENDER_WAIT_MS 2
+// Timer ticks the frontend runs back to back when it falls behind wall time, before giving up on them
+#define CHIP8_MAX_CATCH_UP_TICKS 4
+
+// Basic block translation cache
+#define CHIP8_BLOCK_MAX_INSTRUCTIONS 16
+#define CHIP8_BLOCK_CACHE_SIZE 64
+#define CHIP8_BLOCK_REGION_SIZE (CHIP8_MEMORY_SIZE / 64)
+
+// Rewind buffer of the frontend: its size in bytes, and how often a full state is recorded
+#define CHIP8_REWIND_BUDGET (16 * 1024 * 1024)
+#define CHIP8_REWIND_KEYFRAME_INTERVAL 60
+
+// Native code buffer of the x86-64 recompiler, flushed when it fills up
+#define CHIP8_JIT_CODE_SIZE (256 * 1024)
+
+// How decoded instructions are dispatched to their handlers. Override it at build time
+// (e.g. /DCHIP8_DISPATCH=0) to benchmark the strategies against each other.
+#define CHIP8_DISPATCH_SWITCH 0
+#define CHIP8_DISPATCH_TABLE 1
+// Threaded code using computed goto, only available with GCC and Clang
+#define CHIP8_DISPATCH_GOTO 2
+
+#ifndef CHIP8_DISPATCH
+#if defined(__GNUC__)
+#define CHIP8_DISPATCH CHIP8_DISPATCH_GOTO
+#else
+#define CHIP8_DISPATCH CHIP8_DISPATCH_TABLE
+#endif
+#endif
+
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_GOTO && !defined(__GNUC__)
+#error "CHIP8_DISPATCH_GOTO requires a compiler that supports computed goto"
+#endif
 
 #endif
 
@@ -1,63 +1,279 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "SDL.h"
 #include "chip8.h"
-#include <Windows.h>
+#include "chip8_frame_buffer.h"
+#include "chip8_input_log.h"
+#include "chip8_platform.h"
+#include "chip8_rewind.h"
 
 const char keyboard_map[CHIP_TOTAL_KEYS] = {
 	SDLK_0, SDLK_1, SDLK_2, SDLK_3, SDLK_4, SDLK_5, SDLK_6, SDLK_7,
 	SDLK_8, SDLK_9, SDLK_a, SDLK_b, SDLK_c, SDLK_d, SDLK_e, SDLK_f
 };
 
-void handle_key_down(struct chip8 *chip8, const SDL_Event event)
+/*
+	Key presses travel from the SDL thread to the emulation thread through a single-producer
+	single-consumer ring: each side only ever writes its own index, so neither takes a lock.
+ */
+enum input_type
 {
-	const int key = event.key.keysym.sym;
-	const int vkey = chip8_keyboard_map(&chip8->keyboard, key);
-	if (vkey != -1)
+	INPUT_KEY_DOWN,
+	INPUT_KEY_UP,
+	INPUT_REWIND_START,
+	INPUT_REWIND_STOP
+};
+
+struct input_event
+{
+	unsigned char type;
+	unsigned char key;
+};
+
+struct input_queue
+{
+	struct input_event events[CHIP8_INPUT_QUEUE_SIZE];
+	// Written by the consumer and the producer respectively, both count up forever
+	SDL_atomic_t head;
+	SDL_atomic_t tail;
+};
+
+// Returns false, dropping the event, when the emulation thread is that far behind
+bool input_queue_push(struct input_queue* queue, const enum input_type type, const int key)
+{
+	const int tail = SDL_AtomicGet(&queue->tail);
+	if (tail - SDL_AtomicGet(&queue->head) == CHIP8_INPUT_QUEUE_SIZE)
+	{
+		return false;
+	}
+
+	struct input_event* event = &queue->events[tail & (CHIP8_INPUT_QUEUE_SIZE - 1)];
+	event->type = (unsigned char)type;
+	event->key = (unsigned char)key;
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&queue->tail, tail + 1);
+	return true;
+}
+
+bool input_queue_pop(struct input_queue* queue, struct input_event* event)
+{
+	const int head = SDL_AtomicGet(&queue->head);
+	if (head == SDL_AtomicGet(&queue->tail))
+	{
+		return false;
+	}
+
+	SDL_MemoryBarrierAcquire();
+	*event = queue->events[head & (CHIP8_INPUT_QUEUE_SIZE - 1)];
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&queue->head, head + 1);
+	return true;
+}
+
+// A square wave played while the sound timer runs, generated on SDL's audio thread
+struct audio
+{
+	// Written by the emulation loop and read by the callback, nothing else is shared
+	SDL_atomic_t playing;
+	// Only used by the callback
+	int phase;
+	int half_period;
+};
+
+void audio_callback(void* userdata, Uint8* stream, const int length)
+{
+	struct audio* audio = userdata;
+	Sint16* samples = (Sint16*)stream;
+	const bool playing = SDL_AtomicGet(&audio->playing) != 0;
+	for (int i = 0; i < length / (int)sizeof(Sint16); i++)
+	{
+		samples[i] = !playing ? 0 : audio->phase < audio->half_period ? CHIP8_AUDIO_AMPLITUDE : -CHIP8_AUDIO_AMPLITUDE;
+		audio->phase = (audio->phase + 1) % (2 * audio->half_period);
+	}
+}
+
+// Streams what was recorded so far to the file
+void write_recording(struct chip8_input_recorder* recorder, FILE* file)
+{
+	fwrite(recorder->data, 1, recorder->size, file);
+	fflush(file);
+	recorder->size = 0;
+}
+
+// Everything the emulation thread owns, and the queues it shares with the SDL thread
+struct emulation
+{
+	struct chip8* chip8;
+	int instructions_per_frame;
+	// NULL when not recording
+	struct chip8_input_recorder* recording;
+	FILE* recording_file;
+	unsigned long long frame;
+	// NULL when rewinding is disabled
+	struct chip8_rewind* rewind;
+	bool rewinding;
+	struct audio* audio;
+	struct input_queue input;
+	struct chip8_frame_buffer frames;
+	SDL_atomic_t running;
+};
+
+// Key transitions are recorded (when recording) before the frame runs, so at instruction 0
+void emulation_apply_input(struct emulation* emulation, const struct input_event* event)
+{
+	struct chip8_keyboard* keyboard = &emulation->chip8->keyboard;
+	switch (event->type)
 	{
-		printf("Key pressed %i\n", vkey);
-		chip8_keyboard_down(&chip8->keyboard, vkey);
+		case INPUT_KEY_DOWN:
+			// key repeat sends more key downs, only the transition is recorded
+			if (emulation->recording != NULL && !chip8_keyboard_is_down(keyboard, event->key))
+			{
+				chip8_input_record(emulation->recording, emulation->frame, 0, event->key, true);
+			}
+			chip8_keyboard_down(keyboard, event->key);
+			break;
+
+		case INPUT_KEY_UP:
+			if (emulation->recording != NULL && chip8_keyboard_is_down(keyboard, event->key))
+			{
+				chip8_input_record(emulation->recording, emulation->frame, 0, event->key, false);
+			}
+			chip8_keyboard_up(keyboard, event->key);
+			break;
+
+		case INPUT_REWIND_START:
+		case INPUT_REWIND_STOP:
+			emulation->rewinding = event->type == INPUT_REWIND_START;
+			break;
+
+		default:
+			break;
 	}
 }
 
-void handle_key_up(struct chip8 *chip8, const SDL_Event event)
+void emulation_run_tick(struct emulation* emulation)
 {
-	const int key = event.key.keysym.sym;
-	const int vkey = chip8_keyboard_map(&chip8->keyboard, key);
-	if (vkey != -1)
+	if (emulation->rewinding && emulation->rewind != NULL)
+	{
+		// Stays on the oldest frame once the buffer runs out
+		chip8_rewind_step_back(emulation->rewind, emulation->chip8);
+		return;
+	}
+
+	if (emulation->rewind != NULL)
+	{
+		chip8_rewind_push(emulation->rewind, emulation->chip8);
+	}
+	chip8_advance(emulation->chip8, emulation->instructions_per_frame);
+	emulation->frame++;
+	if (emulation->recording != NULL && emulation->frame % CHIP8_FRAMES_PER_SECOND == 0)
 	{
-		chip8_keyboard_up(&chip8->keyboard, vkey);
+		write_recording(emulation->recording, emulation->recording_file);
 	}
 }
 
-void draw_pixels(const struct chip8 chip8, SDL_Renderer* renderer)
+/*
+	The CPU and timer loop, on its own thread so that vsync and window manager stalls of
+	the SDL thread never delay it. The virtual clock (see chip8_clock.h) ticks the timers
+	every instructions_per_frame instructions; all this loop does is run one tick's worth
+	every 1/60th of a second.
+ */
+void emulation_thread(void* argument)
 {
-	for (int x = 0; x < CHIP8_WIDTH; x++)
+	struct emulation* emulation = argument;
+	struct chip8* chip8 = emulation->chip8;
+	const unsigned long long tick_duration = 1000000000ULL / CHIP8_FRAMES_PER_SECOND;
+	unsigned long long next_tick = chip8_platform_time_ns();
+	// the texture starts out blank, all of the first screen goes up
+	chip8->screen.dirty_rows = CHIP8_SCREEN_ALL_ROWS;
+
+	while (SDL_AtomicGet(&emulation->running))
 	{
-		for (int y = 0; y < CHIP8_HEIGHT; y++)
+		struct input_event event;
+		while (input_queue_pop(&emulation->input, &event))
+		{
+			emulation_apply_input(emulation, &event);
+		}
+
+		// Runs the ticks that are due by now, catching up on a few when the host fell behind
+		const unsigned long long now = chip8_platform_time_ns();
+		for (int due = 0; due < CHIP8_MAX_CATCH_UP_TICKS && next_tick <= now; due++)
+		{
+			emulation_run_tick(emulation);
+			next_tick += tick_duration;
+		}
+		if (next_tick <= now)
 		{
-			if (chip8_screen_is_set(&chip8.screen, x, y))
+			// Too far behind, don't try to catch up on the rest
+			next_tick = now + tick_duration;
+		}
+
+		// The audio callback never waits on the emulation, it only reads this flag
+		SDL_AtomicSet(&emulation->audio->playing, chip8->registers.sound_timer > 0);
+
+		// Screens without changed rows aren't published at all
+		const unsigned int dirty_rows = chip8_screen_take_dirty_rows(&chip8->screen);
+		if (dirty_rows != 0)
+		{
+			chip8_frame_buffer_publish(&emulation->frames, &chip8->screen, dirty_rows);
+		}
+
+		// Idle programs cost next to nothing here, chip8_advance fast-forwards over their loops
+		const unsigned long long after = chip8_platform_time_ns();
+		if (after < next_tick)
+		{
+			chip8_platform_sleep_ns(next_tick - after);
+		}
+	}
+}
+
+// Converts the dirty rows of the packed framebuffer into ARGB pixels of the streaming texture, one lock per run of rows
+void draw_pixels(const struct chip8_screen* screen, SDL_Texture* texture)
+{
+	int y = 0;
+	while (y < CHIP8_HEIGHT)
+	{
+		if ((screen->dirty_rows >> y & 1) == 0)
+		{
+			y++;
+			continue;
+		}
+		int end = y + 1;
+		while (end < CHIP8_HEIGHT && (screen->dirty_rows >> end & 1) != 0)
+		{
+			end++;
+		}
+
+		const SDL_Rect rect = { 0, y, CHIP8_WIDTH, end - y };
+		void* pixels;
+		int pitch;
+		if (SDL_LockTexture(texture, &rect, &pixels, &pitch) != 0)
+		{
+			printf("Failed to lock the screen texture: %s\n", SDL_GetError());
+			return;
+		}
+		for (; y < end; y++)
+		{
+			Uint32* row = (Uint32*)((Uint8*)pixels + (y - rect.y) * pitch);
+			const unsigned long long bits = screen->pixels[y];
+			for (int x = 0; x < CHIP8_WIDTH; x++)
 			{
-				SDL_Rect r;
-				r.x = x * CHIP8_WINDOW_SCALE;
-				r.y = y * CHIP8_WINDOW_SCALE;
-				r.w = CHIP8_WINDOW_SCALE;
-				r.h = CHIP8_WINDOW_SCALE;
-				SDL_RenderFillRect(renderer, &r);
+				row[x] = (bits >> (CHIP8_WIDTH - 1 - x)) & 1 ? CHIP8_PIXEL_ON_COLOR : CHIP8_PIXEL_OFF_COLOR;
 			}
 		}
+		SDL_UnlockTexture(texture);
 	}
 }
 
 int load_rom(const char* filename, char** buf, size_t *size)
 {
-	FILE* file;
-
-	const int err = fopen_s(&file, filename, "rb");
+	FILE* file = fopen(filename, "rb");
 
 	if (!file)
 	{
 		puts("Failed to open file");
-		return err;
+		return -1;
 	}
 
 	fseek(file, 0, SEEK_END);
@@ -85,8 +301,6 @@ int load_rom(const char* filename, char** buf, size_t *size)
 	if (result != 1)
 	{
 		puts("Failed to read file");
-		fclose(file);
-		
 		return -1;
 	}
 	return 0;
@@ -102,6 +316,17 @@ int main(const int argc, const char** argv)
 
 	const char* filename = argv[1];
 
+	int instructions_per_frame = CHIP8_INSTRUCTIONS_PER_FRAME;
+	if (argc > 2)
+	{
+		instructions_per_frame = atoi(argv[2]);
+		if (instructions_per_frame <= 0)
+		{
+			puts("The number of instructions per frame must be greater than zero.");
+			return -1;
+		}
+	}
+
 	size_t size;
 	char* buf = NULL;
 	const int result = load_rom(filename, &buf, &size);
@@ -115,8 +340,66 @@ int main(const int argc, const char** argv)
 	chip8_init(&chip8);
 	chip8_load(&chip8, buf, size);
 	chip8_keyboard_set_map(&chip8.keyboard, keyboard_map);
+	const unsigned long long seed = chip8_platform_time_ns();
+	chip8_seed(&chip8, seed);
+	if (!chip8_set_engine(&chip8, CHIP8_ENGINE_JIT))
+	{
+		chip8_set_engine(&chip8, CHIP8_ENGINE_BLOCKS);
+	}
+
+	// The third argument records the session to an input log, which chip8-bench --replay plays back
+	struct chip8_input_recorder recorder;
+	struct chip8_input_recorder* recording = NULL;
+	FILE* recording_file = NULL;
+	if (argc > 3)
+	{
+		if (instructions_per_frame > CHIP8_INPUT_LOG_MAX_INSTRUCTIONS_PER_FRAME)
+		{
+			printf("An input log can't record more than %d instructions per frame.\n", CHIP8_INPUT_LOG_MAX_INSTRUCTIONS_PER_FRAME);
+			return -1;
+		}
+		recording_file = fopen(argv[3], "wb");
+		if (recording_file == NULL || !chip8_input_recorder_start(&recorder, &chip8, seed, instructions_per_frame))
+		{
+			printf("Failed to record to %s\n", argv[3]);
+			return -1;
+		}
+		recording = &recorder;
+	}
+
+	struct emulation emulation = { 0 };
+	emulation.chip8 = &chip8;
+	emulation.instructions_per_frame = instructions_per_frame;
+	emulation.recording = recording;
+	emulation.recording_file = recording_file;
+	// Holding backspace plays the last minutes backwards. Not while recording, a replay can't go back in time.
+	emulation.rewind = recording == NULL ? chip8_rewind_create(CHIP8_REWIND_BUDGET, CHIP8_REWIND_KEYFRAME_INTERVAL) : NULL;
+	chip8_frame_buffer_init(&emulation.frames);
+	chip8_set_instructions_per_tick(&chip8, instructions_per_frame);
 
 	SDL_Init(SDL_INIT_EVERYTHING);
+
+	struct audio audio = { 0 };
+	SDL_AudioSpec wanted = { 0 };
+	SDL_AudioSpec obtained;
+	wanted.freq = CHIP8_AUDIO_SAMPLE_RATE;
+	wanted.format = AUDIO_S16SYS;
+	wanted.channels = 1;
+	wanted.samples = CHIP8_AUDIO_BUFFER_SAMPLES;
+	wanted.callback = audio_callback;
+	wanted.userdata = &audio;
+	const SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(NULL, 0, &wanted, &obtained, 0);
+	if (audio_device != 0)
+	{
+		audio.half_period = obtained.freq / (2 * CHIP8_TONE_FREQUENCY);
+		SDL_PauseAudioDevice(audio_device, 0);
+	}
+	else
+	{
+		printf("No sound: %s\n", SDL_GetError());
+	}
+	emulation.audio = &audio;
+
 	SDL_Window* window = SDL_CreateWindow(
 		EMULATOR_WINDOW_TITLE,
 		SDL_WINDOWPOS_UNDEFINED,
@@ -125,64 +408,107 @@ int main(const int argc, const char** argv)
 		CHIP8_HEIGHT * CHIP8_WINDOW_SCALE,
 		SDL_WINDOW_SHOWN);
 
-	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_TEXTUREACCESS_TARGET);
+	// Presenting waits for the display refresh, which paces this thread and no other
+	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+	// The screen is uploaded into a 64x32 texture and SDL scales it up to the window size
+	SDL_Texture* texture = SDL_CreateTexture(
+		renderer,
+		SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
+		CHIP8_WIDTH,
+		CHIP8_HEIGHT);
+
+	SDL_AtomicSet(&emulation.running, 1);
+	struct chip8_thread* thread = chip8_platform_thread_create(emulation_thread, &emulation);
+	if (thread == NULL)
+	{
+		puts("Failed to start the emulation thread");
+		return -1;
+	}
+
+	// This thread only maps keys, it never touches the instance
+	struct chip8_keyboard keyboard = { 0 };
+	chip8_keyboard_set_map(&keyboard, keyboard_map);
+	bool redraw = false;
 
 	while (1)
 	{
 		SDL_Event event;
-		while (SDL_PollEvent(&event))
+		// Sleeps until there is input, or for long enough that a new screen may be ready
+		if (SDL_WaitEventTimeout(&event, CHIP8_RENDER_WAIT_MS))
 		{
-			switch (event.type)
-			{
-			case SDL_QUIT:
-				goto out;
-
-			case SDL_KEYDOWN:
+			do
 			{
-				handle_key_down(&chip8, event);
-			}
-
-			break;
-
-			case SDL_KEYUP:
-			{
-				handle_key_up(&chip8, event);
-			}
-			break;
-
-			default:;
+				switch (event.type)
+				{
+				case SDL_QUIT:
+					goto out;
+
+				case SDL_KEYDOWN:
+				case SDL_KEYUP:
+				{
+					const bool down = event.type == SDL_KEYDOWN;
+					if (event.key.keysym.sym == SDLK_BACKSPACE)
+					{
+						input_queue_push(&emulation.input, down ? INPUT_REWIND_START : INPUT_REWIND_STOP, 0);
+					}
+					const int vkey = chip8_keyboard_map(&keyboard, event.key.keysym.sym);
+					if (vkey != -1)
+					{
+						if (down)
+						{
+							printf("Key pressed %i\n", vkey);
+						}
+						input_queue_push(&emulation.input, down ? INPUT_KEY_DOWN : INPUT_KEY_UP, vkey);
+					}
+				}
 				break;
-			}
-		}
 
-		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-		SDL_RenderClear(renderer);
-		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 0);
+				case SDL_WINDOWEVENT:
+					redraw = true;
+					break;
 
-		draw_pixels(chip8, renderer);
-
-		SDL_RenderPresent(renderer);
+				default:;
+					break;
+				}
+			} while (SDL_PollEvent(&event));
+		}
 
-		if (chip8.registers.delay_timer > 0)
+		// Only new screens are uploaded, and of those only the rows that changed
+		const struct chip8_screen* screen = chip8_frame_buffer_take(&emulation.frames);
+		if (screen != NULL)
 		{
-			Sleep(10);
-			chip8.registers.delay_timer -= 1;
+			draw_pixels(screen, texture);
+			redraw = true;
 		}
 
-		if (chip8.registers.sound_timer > 0)
+		if (redraw)
 		{
-			Beep(400, 10 * chip8.registers.sound_timer);
-			chip8.registers.sound_timer = 0;
+			SDL_RenderCopy(renderer, texture, NULL, NULL);
+			SDL_RenderPresent(renderer);
+			redraw = false;
 		}
-
-		const unsigned short opcode = chip8_memory_get_short(&chip8.memory, chip8.registers.PC);
-		chip8.registers.PC += 2;
-		chip8_exec(&chip8, opcode);
 	}
 
 out:
+	SDL_AtomicSet(&emulation.running, 0);
+	chip8_platform_thread_join(thread);
+	SDL_DestroyTexture(texture);
+	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
+	if (audio_device != 0)
+	{
+		SDL_CloseAudioDevice(audio_device);
+	}
+	chip8_rewind_destroy(emulation.rewind);
+	if (recording != NULL)
+	{
+		chip8_input_recorder_finish(recording, emulation.frame);
+		write_recording(recording, recording_file);
+		chip8_input_recorder_free(recording);
+		fclose(recording_file);
+	}
+	chip8_destroy(&chip8);
 	return 0;
 }
-
-